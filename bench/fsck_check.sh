@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Object writer cross-check: the same seeded run through the porcelain
+# backend (one `git commit` per commit) and the objects backend (objects
+# written by cyclops itself), each into a fresh repository. Both must end
+# on the same commit and both must pass `git fsck --strict`.
+#
+# Build: make bench/cyclops (optimized; make fsck_check builds it and runs this)
+# Usage: bench/fsck_check.sh [seed] [start] [end] [max_per_day]
+
+set -e
+
+cyclops="$(cd "$(dirname "$0")" && pwd)/cyclops"
+seed=${1:-1}
+start=${2:-2023-11-01}
+end=${3:-2023-12-31}
+per_day=${4:-5}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+[ -x "$cyclops" ] || { echo "error: build $cyclops first (make bench/cyclops)" >&2; exit 1; }
+
+echo "seed=$seed range=$start..$end max=$per_day"
+for backend in porcelain objects; do
+    mkdir "$work/$backend"
+    (cd "$work/$backend" && "$cyclops" --seed="$seed" --backend="$backend" --rate=0 \
+        "$start" "$end" "$per_day") >"$work/$backend.log" 2>&1 || {
+        cat "$work/$backend.log" >&2
+        echo "error: --backend=$backend failed" >&2
+        exit 1
+    }
+    if ! git -C "$work/$backend" fsck --strict --no-progress; then
+        echo "error: git fsck --strict failed for --backend=$backend" >&2
+        exit 1
+    fi
+    printf "%-10s %s\n" "$backend" "$(git -C "$work/$backend" rev-parse HEAD)"
+done
+
+porcelain=$(git -C "$work/porcelain" rev-parse HEAD)
+objects=$(git -C "$work/objects" rev-parse HEAD)
+if [ "$porcelain" != "$objects" ]; then
+    echo "error: --backend=objects ended on $objects, porcelain on $porcelain" >&2
+    exit 1
+fi
+echo "ok: same HEAD, fsck --strict clean"
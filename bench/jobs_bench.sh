@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# --jobs scaling benchmark: the same seeded run with 1..N hashing threads,
+# into a fresh bare repository each time. Every run must end on the same
+# commit; the table shows wall time and speedup over --jobs=1.
+#
+# Build: make bench/cyclops (optimized; make jobs_bench builds it and runs this)
+# Usage: bench/jobs_bench.sh [max_jobs] [backend] [start] [end] [max_per_day]
+
+set -e
+
+cyclops="$(cd "$(dirname "$0")" && pwd)/cyclops"
+max_jobs=${1:-$(nproc 2>/dev/null || echo 4)}
+backend=${2:-objects}
+start=${3:-2023-01-01}
+end=${4:-2023-12-31}
+per_day=${5:-10}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+echo "backend=$backend range=$start..$end max=$per_day cpus=$(nproc 2>/dev/null || echo ?)"
+printf "%6s %10s %8s  %s\n" jobs wall_ms speedup head
+expected=
+base=
+jobs=1
+while [ "$jobs" -le "$max_jobs" ]; do
+    rm -rf "$work/repo.git"
+    started=$(now_ms)
+    "$cyclops" --seed=1 --backend="$backend" --jobs="$jobs" --git-dir="$work/repo.git" \
+        "$start" "$end" "$per_day" >/dev/null
+    wall=$(($(now_ms) - started))
+    head=$(git --git-dir="$work/repo.git" rev-parse HEAD)
+    if [ -z "$expected" ]; then
+        expected=$head
+        base=$wall
+    elif [ "$head" != "$expected" ]; then
+        echo "error: --jobs=$jobs ended on $head, expected $expected" >&2
+        exit 1
+    fi
+    printf "%6d %10d %8s  %s\n" "$jobs" "$wall" \
+        "$(awk "BEGIN { printf \"%.2fx\", $base / ($wall ? $wall : 1) }")" "$head"
+    jobs=$((jobs + 1))
+done
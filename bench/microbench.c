@@ -0,0 +1,562 @@
+/*
+ * Microbenchmarks for the pure-CPU helpers: date parsing, calendar
+ * arithmetic, commit message selection and activity entry formatting.
+ * Every case runs the same number of iterations in each trial, after
+ * untimed warm-up trials, and reports the minimum and median time per
+ * iteration over the trials.
+ *
+ * Cases are grouped: every case of a group does the same work, the first
+ * one is the current implementation and the others are shown as a ratio
+ * of its median. To try a replacement, add a function with the case
+ * signature and a row under the group in cases[]; rows marked exact must
+ * return the same checksum as the first one, so a replacement that gets
+ * an answer wrong fails the run instead of winning it.
+ *
+ * Build: make microbench
+ * Usage: bench/microbench [--iterations=N] [--trials=N] [--warmup=N] [group...]
+ */
+
+#define CYCLOPS_NO_MAIN
+#include "../cyclops.c"
+
+#include <ctype.h>
+
+/* ---- Previous implementations, kept verbatim for comparison ---- */
+
+int legacy_is_leap_year(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+}
+
+int legacy_days_in_month(int month, int year) {
+    int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month == 2 && legacy_is_leap_year(year)) {
+        return 29;
+    }
+    return days[month - 1];
+}
+
+void legacy_increment_date(Date* date) {
+    date->day++;
+    
+    if (date->day > legacy_days_in_month(date->month, date->year)) {
+        date->day = 1;
+        date->month++;
+        
+        if (date->month > 12) {
+            date->month = 1;
+            date->year++;
+        }
+    }
+}
+
+int legacy_compare_dates(const Date* date1, const Date* date2) {
+    if (date1->year != date2->year) {
+        return (date1->year < date2->year) ? -1 : 1;
+    }
+    if (date1->month != date2->month) {
+        return (date1->month < date2->month) ? -1 : 1;
+    }
+    if (date1->day != date2->day) {
+        return (date1->day < date2->day) ? -1 : 1;
+    }
+    return 0;
+}
+
+int legacy_parse_date(const char* date_str, Date* date) {
+    if (sscanf(date_str, "%d-%d-%d", &date->year, &date->month, &date->day) != 3) {
+        return 0;
+    }
+    
+    /* Basic validation */
+    if (date->year < 1900 || date->year > 2100 ||
+        date->month < 1 || date->month > 12 ||
+        date->day < 1 || date->day > 31) {
+        return 0;
+    }
+    
+    return 1;
+}
+
+/* ---- Candidate replacements ---- */
+
+/* One sscanf %d: optional white space and sign, then at least one digit */
+int scan_number(const char** cursor, int* value) {
+    const char* p = *cursor;
+    int negative = 0;
+    int result = 0;
+    
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+    if (*p == '-' || *p == '+') {
+        negative = *p++ == '-';
+    }
+    if (!isdigit((unsigned char)*p)) {
+        return 0;
+    }
+    while (isdigit((unsigned char)*p)) {
+        result = result * 10 + (*p++ - '0');
+    }
+    *value = negative ? -result : result;
+    *cursor = p;
+    return 1;
+}
+
+/* parse_date without sscanf; the validation is unchanged */
+int candidate_parse_date(const char* date_str, Date* date) {
+    const char* p = date_str;
+    Date check;
+    
+    if (!scan_number(&p, &date->year) || *p++ != '-' ||
+        !scan_number(&p, &date->month) || *p++ != '-' ||
+        !scan_number(&p, &date->day)) {
+        return 0;
+    }
+    if (date->month < 1 || date->month > 12 || date->day < 1 || date->day > 31) {
+        return 0;
+    }
+    civil_from_days(days_from_civil(date->year, date->month, date->day), &check);
+    if (check.day != date->day) {
+        return 0;
+    }
+    if (date->year < 1970 || date->year > 9999) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Append a number in decimal, at least width digits wide */
+char* put_number(char* out, int value, int width) {
+    char digits[12];
+    int count = 0;
+    
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count < width) {
+        digits[count++] = '0';
+    }
+    while (count > 0) {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+#define PUT_LITERAL(out, text) (memcpy(out, text, sizeof(text) - 1), (out) + sizeof(text) - 1)
+
+/* format_activity_entry without snprintf, for non-negative numbers */
+int candidate_format_activity_entry(char* entry, const Date* date, int number, int session,
+                                    int lines) {
+    char* out = entry;
+    
+    out = PUT_LITERAL(out, "// Activity log: ");
+    out = put_number(out, date->year, 4);
+    *out++ = '-';
+    out = put_number(out, date->month, 2);
+    *out++ = '-';
+    out = put_number(out, date->day, 2);
+    out = PUT_LITERAL(out, " #");
+    out = put_number(out, number, 1);
+    out = PUT_LITERAL(out, "\n// Session: ");
+    out = put_number(out, session, 1);
+    out = PUT_LITERAL(out, " minutes of development work\n// Changes: ");
+    out = put_number(out, lines, 1);
+    out = PUT_LITERAL(out, " lines modified\n"
+        "/* Generated activity to demonstrate the meaninglessness of GitHub metrics */\n\n");
+    *out = '\0';
+    return (int)(out - entry);
+}
+
+/* ---- Inputs ---- */
+
+/* Command-line dates, including every way one can be rejected */
+const char* date_inputs[] = {
+    "2024-01-01", "2023-12-31", "2024-02-29", "2023-02-29", "2023-02-30", "1970-01-01",
+    "1969-12-31", "9999-12-31", "2023-13-01", "2023-00-10", "2023-06-31", "2023-1-5",
+    "2021-07-04", "2022-11-15", "2019-03-08", "bogus",      "2023-06",    "2000-02-29",
+    "1900-02-29", "2100-03-01", "2015-10-21", "2020-05-17", "2012-12-12", "2023-09-30"
+};
+
+#define NUM_DATE_INPUTS ((int)(sizeof(date_inputs) / sizeof(date_inputs[0])))
+
+/* The calendar cases walk 1900-01-01 to 2099-12-31 and wrap around */
+const Date span_start = {1900, 1, 1};
+const Date span_end = {2099, 12, 31};
+
+/* Keeps the compiler from discarding the loops */
+volatile uint64_t sink;
+
+/* ---- Cases: each runs the given number of iterations and returns a checksum ---- */
+
+uint64_t bench_parse_date(int64_t iterations) {
+    uint64_t checksum = 0;
+    Date date;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        if (parse_date(date_inputs[i % NUM_DATE_INPUTS], &date)) {
+            checksum += date.year * 372 + date.month * 31 + date.day;
+        } else {
+            checksum++;
+        }
+    }
+    return checksum;
+}
+
+uint64_t bench_legacy_parse_date(int64_t iterations) {
+    uint64_t checksum = 0;
+    Date date;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        if (legacy_parse_date(date_inputs[i % NUM_DATE_INPUTS], &date)) {
+            checksum += date.year * 372 + date.month * 31 + date.day;
+        } else {
+            checksum++;
+        }
+    }
+    return checksum;
+}
+
+uint64_t bench_candidate_parse_date(int64_t iterations) {
+    uint64_t checksum = 0;
+    Date date;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        if (candidate_parse_date(date_inputs[i % NUM_DATE_INPUTS], &date)) {
+            checksum += date.year * 372 + date.month * 31 + date.day;
+        } else {
+            checksum++;
+        }
+    }
+    return checksum;
+}
+
+uint64_t bench_civil_from_days(int64_t iterations) {
+    int64_t start_day = days_from_civil(span_start.year, span_start.month, span_start.day);
+    int64_t end_day = days_from_civil(span_end.year, span_end.month, span_end.day);
+    int64_t day = start_day;
+    uint64_t checksum = 0;
+    Date date;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        civil_from_days(day, &date);
+        checksum += date.year * 372 + date.month * 31 + date.day;
+        day = day == end_day ? start_day : day + 1;
+    }
+    return checksum;
+}
+
+uint64_t bench_legacy_increment_date(int64_t iterations) {
+    uint64_t checksum = 0;
+    Date date = span_start;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        checksum += date.year * 372 + date.month * 31 + date.day;
+        legacy_increment_date(&date);
+        if (legacy_compare_dates(&date, &span_end) > 0) {
+            date = span_start;
+        }
+    }
+    return checksum;
+}
+
+uint64_t bench_weekday_from_days(int64_t iterations) {
+    int64_t start_day = days_from_civil(span_start.year, span_start.month, span_start.day);
+    int64_t end_day = days_from_civil(span_end.year, span_end.month, span_end.day);
+    int64_t day = start_day;
+    uint64_t checksum = 0;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        checksum += weekday_from_days(day);
+        day = day == end_day ? start_day : day + 1;
+    }
+    return checksum;
+}
+
+/* Month lengths the epoch-day way: the distance to the next month's first day */
+uint64_t bench_month_length(int64_t iterations) {
+    uint64_t checksum = 0;
+    int year = span_start.year;
+    int month = 1;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        checksum += days_from_civil(year, month + 1, 1) - days_from_civil(year, month, 1);
+        if (++month > 12) {
+            month = 1;
+            year = year == span_end.year ? span_start.year : year + 1;
+        }
+    }
+    return checksum;
+}
+
+uint64_t bench_legacy_days_in_month(int64_t iterations) {
+    uint64_t checksum = 0;
+    int year = span_start.year;
+    int month = 1;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        checksum += legacy_days_in_month(month, year);
+        if (++month > 12) {
+            month = 1;
+            year = year == span_end.year ? span_start.year : year + 1;
+        }
+    }
+    return checksum;
+}
+
+/* Length of every month-long range in the span: subtract two numbers, or walk it */
+uint64_t bench_range_subtraction(int64_t iterations) {
+    uint64_t checksum = 0;
+    int year = span_start.year;
+    int month = 1;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        int64_t first = days_from_civil(year, month, 1);
+        checksum += days_from_civil(year, month + 1, 1) - 1 - first + 1;
+        if (++month > 12) {
+            month = 1;
+            year = year == span_end.year ? span_start.year : year + 1;
+        }
+    }
+    return checksum;
+}
+
+uint64_t bench_legacy_range_walk(int64_t iterations) {
+    uint64_t checksum = 0;
+    int year = span_start.year;
+    int month = 1;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        Date date = {year, month, 1};
+        Date end = {year, month, legacy_days_in_month(month, year)};
+    
+        while (legacy_compare_dates(&date, &end) <= 0) {
+            checksum++;
+            legacy_increment_date(&date);
+        }
+        if (++month > 12) {
+            month = 1;
+            year = year == span_end.year ? span_start.year : year + 1;
+        }
+    }
+    return checksum;
+}
+
+uint64_t bench_generate_commit_message(int64_t iterations) {
+    Date date = {2023, 1, 1};
+    uint64_t checksum = 0;
+    RandomStream random;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        date.day = 1 + (int)(i / 64 % 28);
+        random_stream(&random, 42, &date, (int)(i % 64) + 1);
+        checksum += generate_commit_message(&random);
+    }
+    return checksum;
+}
+
+uint64_t bench_legacy_rand_message(int64_t iterations) {
+    uint64_t checksum = 0;
+    
+    srand(42);
+    for (int64_t i = 0; i < iterations; i++) {
+        checksum += rand() % NUM_COMMIT_MESSAGES;
+    }
+    return checksum;
+}
+
+/* Session and line counts vary the way plan_commit draws them */
+#define ENTRY_ARGUMENTS(i) \
+    &entry_dates[(i) % 4], (int)((i) % 50) + 1, (int)((i) % 180) + 30, (int)((i) % 100) + 10
+
+const Date entry_dates[] = {{2023, 1, 1}, {2023, 6, 15}, {2024, 2, 29}, {2019, 11, 30}};
+
+uint64_t bench_format_activity_entry(int64_t iterations) {
+    char entry[MAX_ENTRY_LENGTH];
+    uint64_t checksum = 0;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        int length = format_activity_entry(entry, sizeof(entry), ENTRY_ARGUMENTS(i));
+        checksum += (uint64_t)length * 131 + (unsigned char)entry[i % length];
+    }
+    return checksum;
+}
+
+uint64_t bench_legacy_fprintf_entry(int64_t iterations) {
+    char entry[MAX_ENTRY_LENGTH];
+    uint64_t checksum = 0;
+    FILE* file = fmemopen(entry, sizeof(entry), "w");
+    
+    if (!file) {
+        return 0;
+    }
+    for (int64_t i = 0; i < iterations; i++) {
+        const Date* date = &entry_dates[i % 4];
+        int length;
+    
+        rewind(file);
+        fprintf(file, "// Activity log: %04d-%02d-%02d #%d\n",
+                date->year, date->month, date->day, (int)(i % 50) + 1);
+        fprintf(file, "// Session: %d minutes of development work\n",
+                (int)(i % 180) + 30);
+        fprintf(file, "// Changes: %d lines modified\n",
+                (int)(i % 100) + 10);
+        fprintf(file, "/* Generated activity to demonstrate the meaninglessness of GitHub metrics */\n\n");
+        fflush(file);
+        length = (int)ftell(file);
+        checksum += (uint64_t)length * 131 + (unsigned char)entry[i % length];
+    }
+    fclose(file);
+    return checksum;
+}
+
+uint64_t bench_candidate_format_entry(int64_t iterations) {
+    char entry[MAX_ENTRY_LENGTH];
+    uint64_t checksum = 0;
+    
+    for (int64_t i = 0; i < iterations; i++) {
+        int length = candidate_format_activity_entry(entry, ENTRY_ARGUMENTS(i));
+        checksum += (uint64_t)length * 131 + (unsigned char)entry[i % length];
+    }
+    return checksum;
+}
+
+/* ---- Harness ---- */
+
+typedef struct {
+    const char* group;
+    const char* name;
+    uint64_t (*run)(int64_t iterations);
+    int exact;    /* Must return the same checksum as the first case of the group */
+} BenchCase;
+
+/* The first case of each group is the current implementation */
+const BenchCase cases[] = {
+    {"parse_date", "parse_date", bench_parse_date, 0},
+    {"parse_date", "legacy (1900-2100 only)", bench_legacy_parse_date, 0},
+    {"parse_date", "candidate: no sscanf", bench_candidate_parse_date, 1},
+    {"calendar", "civil_from_days", bench_civil_from_days, 0},
+    {"calendar", "legacy increment_date", bench_legacy_increment_date, 1},
+    {"weekday", "weekday_from_days", bench_weekday_from_days, 0},
+    {"month_length", "days_from_civil difference", bench_month_length, 0},
+    {"month_length", "legacy days_in_month", bench_legacy_days_in_month, 1},
+    {"range_length", "epoch subtraction", bench_range_subtraction, 0},
+    {"range_length", "legacy walk", bench_legacy_range_walk, 1},
+    {"message", "generate_commit_message", bench_generate_commit_message, 0},
+    {"message", "legacy rand() %", bench_legacy_rand_message, 0},
+    {"entry", "format_activity_entry", bench_format_activity_entry, 0},
+    {"entry", "legacy fprintf", bench_legacy_fprintf_entry, 1},
+    {"entry", "candidate: no snprintf", bench_candidate_format_entry, 1}
+};
+
+#define NUM_CASES ((int)(sizeof(cases) / sizeof(cases[0])))
+
+/**
+ * Order trial times ascending, for qsort
+ * @return: <0, 0 or >0
+ */
+int time_compare(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Check whether a group was asked for on the command line
+ * @param group: Group name
+ * @param names: Requested groups
+ * @param count: Number of requested groups, 0 for all
+ * @return: 1 if the group should run, 0 otherwise
+ */
+int group_selected(const char* group, char* names[], int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(group, names[i]) == 0) {
+            return 1;
+        }
+    }
+    return count == 0;
+}
+
+int main(int argc, char* argv[]) {
+    int64_t iterations = 1000000;
+    int trials = 7;
+    int warmup = 1;
+    char* groups[NUM_CASES];
+    int group_count = 0;
+    const char* baseline_name = NULL;
+    double baseline_median = 0;
+    uint64_t baseline_checksum = 0;
+    int failed = 0;
+    double* times;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--iterations=", 13) == 0) {
+            iterations = atoll(argv[i] + 13);
+        } else if (strncmp(argv[i], "--trials=", 9) == 0) {
+            trials = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--warmup=", 9) == 0) {
+            warmup = atoi(argv[i] + 9);
+        } else if (argv[i][0] != '-' && group_count < NUM_CASES) {
+            groups[group_count++] = argv[i];
+        } else {
+            iterations = 0;
+        }
+    }
+    if (iterations < 1 || trials < 1 || warmup < 0) {
+        fprintf(stderr, "Usage: %s [--iterations=N] [--trials=N] [--warmup=N] [group...]\n",
+                argv[0]);
+        return 1;
+    }
+    times = malloc(trials * sizeof(double));
+    if (!times) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    
+    printf("%lld iterations x %d trials, %d warm-up\n", (long long)iterations, trials, warmup);
+    printf("  %-30s %12s %12s %8s\n", "case", "min ns/op", "median ns/op", "vs first");
+    for (int c = 0; c < NUM_CASES; c++) {
+        const BenchCase* bench = &cases[c];
+        int first = c == 0 || strcmp(bench->group, cases[c - 1].group) != 0;
+        uint64_t checksum = 0;
+        double median;
+    
+        if (!group_selected(bench->group, groups, group_count)) {
+            continue;
+        }
+        if (first) {
+            printf("%s\n", bench->group);
+        }
+    
+        for (int trial = 0; trial < warmup; trial++) {
+            sink += bench->run(iterations);
+        }
+        for (int trial = 0; trial < trials; trial++) {
+            double started = monotonic_seconds();
+            checksum = bench->run(iterations);
+            times[trial] = (monotonic_seconds() - started) * 1e9 / iterations;
+            sink += checksum;
+        }
+        qsort(times, trials, sizeof(double), time_compare);
+        median = times[trials / 2];
+    
+        if (first) {
+            baseline_name = bench->name;
+            baseline_median = median;
+            baseline_checksum = checksum;
+            printf("  %-30s %12.2f %12.2f %8s\n", bench->name, times[0], median, "-");
+        } else {
+            printf("  %-30s %12.2f %12.2f %7.2fx\n", bench->name, times[0], median,
+                   median / baseline_median);
+        }
+        if (bench->exact && checksum != baseline_checksum) {
+            fprintf(stderr, "Error: %s / %s disagrees with %s (checksum %llu, expected %llu)\n",
+                    bench->group, bench->name, baseline_name, (unsigned long long)checksum,
+                    (unsigned long long)baseline_checksum);
+            failed = 1;
+        }
+    }
+    
+    free(times);
+    return failed;
+}
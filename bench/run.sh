@@ -0,0 +1,127 @@
+#!/bin/sh
+#
+# Backend benchmark matrix: every backend over the same seeded runs of one
+# month, one year and ten years at 1, 5 and 50 max commits per day, each
+# into a fresh repository in a temporary directory. One tab-separated line
+# per run is appended to bench_output.txt (or $BENCH_OUTPUT), tagged with
+# the source revision; seeds and ranges are fixed, so the lines of two
+# revisions describe the same histories and line up cell by cell:
+#
+#   sh bench/run.sh --compare old.txt new.txt
+#
+# Build: make bench/cyclops (optimized; make bench builds it and runs this)
+# Usage: bench/run.sh [backend...]
+#   RANGES="month year decade"  MAXES="1 5 50"  LAYOUT=month
+#   SLOW_LIMIT=3000: porcelain skips plans with more commits than this
+
+set -e
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+cyclops="$root/bench/cyclops"
+output=${BENCH_OUTPUT:-$root/bench_output.txt}
+ranges=${RANGES:-month year decade}
+maxes=${MAXES:-1 5 50}
+# The single layout rehashes one ever-growing file per commit, which turns
+# ten-year runs quadratic; sharding keeps every cell measuring the backend
+layout=${LAYOUT:-month}
+slow_limit=${SLOW_LIMIT:-3000}
+seed=1
+
+if [ "$1" = "--compare" ]; then
+    [ $# -eq 3 ] || { echo "usage: $0 --compare old.txt new.txt" >&2; exit 1; }
+    # Join on backend, range, max and layout; keep each file's last result
+    awk -F '\t' '
+        $1 == "rev" { next }
+        FNR == NR { old[$2 FS $3 FS $4 FS $5] = $8; next }
+        { new[$2 FS $3 FS $4 FS $5] = $8 }
+        END {
+            printf "%-12s %-7s %4s %12s %12s %8s\n", "backend", "range", "max", "old c/s",
+                   "new c/s", "change"
+            for (key in new) {
+                if (!(key in old)) continue
+                split(key, f, FS)
+                change = old[key] > 0 ? new[key] / old[key] : 0
+                printf "%-12s %-7s %4s %12.1f %12.1f %7.2fx%s\n", f[1], f[2], f[3], old[key],
+                       new[key], change, change < 0.9 ? "  <- slower" : ""
+            }
+        }' "$2" "$3" | sort -k1,1 -k2,2 -k3,3n
+    exit 0
+fi
+
+backends=${*:-fast-import objects pack plumbing batch porcelain memory}
+[ -x "$cyclops" ] || { echo "error: build $cyclops first (make bench/cyclops)" >&2; exit 1; }
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+rev=$(git -C "$root" rev-parse --short HEAD 2>/dev/null || echo unknown)
+if ! git -C "$root" diff --quiet HEAD -- cyclops.c 2>/dev/null; then
+    rev="$rev-dirty"
+fi
+
+range_dates() {
+    case $1 in
+    month) echo "2023-01-01 2023-01-31" ;;
+    year) echo "2023-01-01 2023-12-31" ;;
+    decade) echo "2014-01-01 2023-12-31" ;;
+    *) echo "error: unknown range $1" >&2; exit 1 ;;
+    esac
+}
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+# Value of a "Label: value" summary line
+field() {
+    sed -n "s/^$1: //p" "$work/out" | head -n 1
+}
+
+if [ ! -s "$output" ]; then
+    printf "rev\tbackend\trange\tmax\tlayout\tcommits\twall_ms\tcommits_per_s\tp50_us\tp99_us\tpeak_rss_kib\tgit_rss_kib\trepo_kib\thead\n" >"$output"
+fi
+echo "rev=$rev layout=$layout cpus=$(nproc 2>/dev/null || echo ?) -> $output"
+printf "%-12s %-7s %4s %8s %10s %10s %10s %10s %10s %10s\n" backend range max commits wall_ms \
+    commits/s p50_us p99_us rss_kib repo_kib
+
+for range in $ranges; do
+    dates=$(range_dates "$range")
+    for max in $maxes; do
+        # shellcheck disable=SC2086
+        planned=$("$cyclops" --seed=$seed --dry-run $dates "$max" | tail -n 1 | cut -d ' ' -f 1)
+        for backend in $backends; do
+            if [ "$backend" = porcelain ] && [ "$planned" -gt "$slow_limit" ]; then
+                printf "%-12s %-7s %4s %8s  skipped (over SLOW_LIMIT=%s)\n" "$backend" "$range" \
+                    "$max" "$planned" "$slow_limit"
+                continue
+            fi
+            rm -rf "$work/repo"
+            mkdir "$work/repo"
+            started=$(now_ms)
+            # shellcheck disable=SC2086
+            (cd "$work/repo" && "$cyclops" --seed=$seed --backend="$backend" --layout="$layout" \
+                --rate=0 $dates "$max") >"$work/out"
+            wall=$(($(now_ms) - started))
+
+            commits=$(field "Total commits created")
+            latency=$(field "Commit latency")
+            p50=$(echo "$latency" | sed -n 's/^p50 \([0-9.]*\) us.*/\1/p')
+            p99=$(echo "$latency" | sed -n 's/.*p99 \([0-9.]*\) us.*/\1/p')
+            rss=$(field "Peak RSS" | sed -n 's/^\([0-9]*\) KiB.*/\1/p')
+            git_rss=$(field "Peak RSS" | sed -n 's/.*git process: \([0-9]*\) KiB.*/\1/p')
+            repo=0
+            if [ -d "$work/repo/.git" ]; then
+                repo=$(du -sk "$work/repo/.git" | cut -f 1)
+                head=$(git -C "$work/repo" rev-parse HEAD 2>/dev/null || echo -)
+            else
+                head=$(sed -n 's/^refs\/heads\/[^ ]* would point at //p' "$work/out")
+            fi
+            rate=$(awk "BEGIN { printf \"%.1f\", $commits * 1000 / ($wall ? $wall : 1) }")
+
+            printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" "$rev" "$backend" \
+                "$range" "$max" "$layout" "$commits" "$wall" "$rate" "${p50:--}" "${p99:--}" \
+                "$rss" "${git_rss:--}" "$repo" "$head" >>"$output"
+            printf "%-12s %-7s %4s %8s %10s %10s %10s %10s %10s %10s\n" "$backend" "$range" \
+                "$max" "$commits" "$wall" "$rate" "${p50:--}" "${p99:--}" "$rss" "$repo"
+        done
+    done
+done
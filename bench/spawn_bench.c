@@ -0,0 +1,110 @@
+/*
+ * Process spawn benchmark: the system()/popen() calls cyclops used to make
+ * against the posix_spawn layer (git_call/read_git_line), running the same
+ * cheap git command. An optional ballast makes the parent big, the way a
+ * long run with a large plan is, since fork() cost grows with the parent.
+ *
+ * Build: make spawn_bench
+ * Usage: bench/spawn_bench [calls] [ballast_mib]
+ */
+
+#define CYCLOPS_NO_MAIN
+#include "../cyclops.c"
+
+/* ---- Previous implementation, kept verbatim for comparison ---- */
+
+int legacy_read_command_line(const char* command, char* output, int max_length) {
+    FILE* pipe = popen(command, "r");
+    int found = 0;
+    
+    output[0] = '\0';
+    if (!pipe) {
+        return 0;
+    }
+    if (fgets(output, max_length, pipe)) {
+        output[strcspn(output, "\n")] = '\0';
+        found = output[0] != '\0';
+    }
+    /* Drain anything left so the child never blocks on a full pipe */
+    while (fgetc(pipe) != EOF) {
+    }
+    if (pclose(pipe) != 0) {
+        return 0;
+    }
+    return found;
+}
+
+int main(int argc, char* argv[]) {
+    const char* version_argv[] = {"git", "--version", NULL};
+    int calls = argc > 1 ? atoi(argv[1]) : 200;
+    size_t ballast_size = (size_t)(argc > 2 ? atoi(argv[2]) : 0) << 20;
+    char* ballast = NULL;
+    char line[MAX_REF_LENGTH];
+    double started, system_time, popen_time, call_time, line_time;
+    GitCall call;
+    
+    if (calls < 1) {
+        fprintf(stderr, "Usage: %s [calls] [ballast_mib]\n", argv[0]);
+        return 1;
+    }
+    if (ballast_size > 0) {
+        ballast = malloc(ballast_size);
+        if (!ballast) {
+            fprintf(stderr, "Error: Cannot allocate the ballast\n");
+            return 1;
+        }
+        memset(ballast, 1, ballast_size); /* Touch every page */
+    }
+    
+    /* Both paths must see the same git */
+    if (!legacy_read_command_line("git --version", line, sizeof(line)) ||
+        !read_git_line(version_argv, NULL, 0, line, sizeof(line))) {
+        fprintf(stderr, "Error: git --version failed\n");
+        return 1;
+    }
+    printf("%s (%s)\n", line, git_path());
+    
+    started = monotonic_seconds();
+    for (int i = 0; i < calls; i++) {
+        if (system("git --version >/dev/null") != 0) {
+            return 1;
+        }
+    }
+    system_time = monotonic_seconds() - started;
+    
+    started = monotonic_seconds();
+    for (int i = 0; i < calls; i++) {
+        if (!legacy_read_command_line("git --version", line, sizeof(line))) {
+            return 1;
+        }
+    }
+    popen_time = monotonic_seconds() - started;
+    
+    started = monotonic_seconds();
+    for (int i = 0; i < calls; i++) {
+        memset(&call, 0, sizeof(call));
+        call.output = line;
+        call.output_size = sizeof(line);
+        if (!git_call(version_argv, &call)) {
+            return 1;
+        }
+    }
+    call_time = monotonic_seconds() - started;
+    
+    started = monotonic_seconds();
+    for (int i = 0; i < calls; i++) {
+        if (!read_git_line(version_argv, NULL, 0, line, sizeof(line))) {
+            return 1;
+        }
+    }
+    line_time = monotonic_seconds() - started;
+    
+    printf("%d calls, %zu MiB ballast\n", calls, ballast_size >> 20);
+    printf("  system(\"git ... >/dev/null\"):   %8.1f us/call\n", system_time * 1e6 / calls);
+    printf("  popen() + first line:           %8.1f us/call\n", popen_time * 1e6 / calls);
+    printf("  git_call (stdout+stderr piped): %8.1f us/call\n", call_time * 1e6 / calls);
+    printf("  read_git_line:                  %8.1f us/call\n", line_time * 1e6 / calls);
+    
+    free(ballast);
+    return 0;
+}
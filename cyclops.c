@@ -19,11 +19,12 @@
  * 
  * Author: jrxna
  * Repository: https://github.com/jrxna/cyclops
- * Compile: gcc -o cyclops cyclops.c
- * Usage: ./cyclops <start_date> <end_date> <max_commits_per_day>
+ * Compile: gcc -o cyclops cyclops.c -lz -lpthread
+ * Usage: ./cyclops [options] <start_date> <end_date> <max_commits_per_day>
  *        Date format: YYYY-MM-DD
  * 
  * Example: ./cyclops 2024-01-01 2024-12-31 5
+ *          ./cyclops --backend=porcelain 2024-01-01 2024-12-31 5
  */
 
 #include <stdio.h>
@@ -31,12 +32,31 @@
 #include <string.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <errno.h>
 #include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <zlib.h>
 
 #define MAX_COMMAND_LENGTH 512
 #define MAX_DATE_LENGTH 32
 #define MAX_MESSAGE_LENGTH 256
+#define MAX_ENTRY_LENGTH 512
+#define MAX_IDENT_LENGTH 256
+#define MAX_REF_LENGTH 256
+#define MAX_PATH_LENGTH 256
 #define DATA_FILE "cyclops_activity.txt"
+#define DATA_DIR "cyclops_activity"
 
 /* Structure to hold date information */
 typedef struct {
@@ -45,6 +65,689 @@ typedef struct {
     int day;
 } Date;
 
+/* Git directory that in-process backends write objects into */
+const char* git_dir = ".git";
+
+/* Set by --git-dir/--bare: the target has no working tree to keep in sync */
+int bare_target = 0;
+
+/* Branch to extend instead of the checked-out one (--branch), or NULL */
+const char* target_branch = NULL;
+
+/* Update the branch every this many commits (--checkpoint); 0 means at the end */
+int checkpoint_interval = 0;
+
+/* Set by --resume: activity files are read from the branch, since a run
+ * that died can leave the working tree behind it */
+int resuming = 0;
+
+/* Objects queued between hashing and storing (--queue-depth); 0 stores
+ * inline, -1 picks DEFAULT_QUEUE_DEPTH when there is a second CPU to use */
+int queue_depth = -1;
+
+/* Threads hashing activity blobs (--jobs), the main thread included */
+int hash_jobs = 1;
+
+/* Where in-process backends store objects: the target's own directory, or
+ * the shared store */
+char object_dir[MAX_PATH_LENGTH] = ".git/objects";
+
+/* Object store shared by every target (--shared-objects), or NULL */
+const char* shared_objects = NULL;
+
+/* Bundle file written instead of a repository (--bundle), or NULL */
+const char* bundle_path = NULL;
+
+/* ---------------------------------------------------------------------- */
+/* Trace: Chrome trace-event spans of a run, kept in memory (--trace)      */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Spans are recorded as fixed-size events into one growing array and only
+ * turned into JSON when the process exits, so a span costs a clock read
+ * and a copy while the run is being timed. The file loads in Perfetto and
+ * chrome://tracing: our own track nests days, commits and their phases,
+ * and every child process gets a track of its own, named by its pid.
+ */
+
+/* What a span covers; also its category in the trace */
+typedef enum {
+    TRACE_DAY,
+    TRACE_COMMIT,
+    TRACE_PHASE,
+    TRACE_PROCESS
+} TraceKind;
+
+const char* trace_kind_names[] = {"day", "commit", "phase", "process"};
+
+typedef struct {
+    uint64_t start;    /* Nanoseconds since the trace began */
+    uint64_t duration;
+    int64_t value;     /* Epoch day of a day, plan row of a commit, pid of a process */
+    int32_t tid;       /* Track: our pid, or a child's */
+    int16_t kind;
+    int16_t count;     /* Commits of a day, number of a commit, exit status of a process */
+    char name[24];
+} TraceEvent;
+
+/* A child spawned and not yet waited for */
+typedef struct {
+    pid_t pid;
+    uint64_t started;
+    char name[24];
+} TraceProcess;
+
+#define MAX_TRACED_PROCESSES 64
+
+typedef struct {
+    const char* path;      /* Where the trace goes at exit; NULL when not tracing */
+    pid_t pid;
+    uint64_t origin;
+    pthread_mutex_t lock;  /* Writer threads spawn processes too */
+    TraceEvent* events;
+    size_t count;
+    size_t capacity;
+    TraceProcess running[MAX_TRACED_PROCESSES];
+} Trace;
+
+Trace trace = {NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * Read the monotonic clock in nanoseconds
+ * @return: Nanoseconds since an arbitrary fixed point
+ */
+uint64_t monotonic_nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Record one finished span
+ * @param kind: What the span covers
+ * @param name: Span name, cut to 23 characters
+ * @param start: Start, from monotonic_nanoseconds()
+ * @param end: End, from monotonic_nanoseconds()
+ * @param tid: Track, 0 for our own
+ * @param value: Epoch day, plan row or pid
+ * @param count: Commits of the day, commit number or exit status
+ */
+void trace_add(TraceKind kind, const char* name, uint64_t start, uint64_t end, pid_t tid,
+               int64_t value, int count) {
+    TraceEvent* event;
+    
+    if (!trace.path) {
+        return;
+    }
+    pthread_mutex_lock(&trace.lock);
+    if (trace.count == trace.capacity) {
+        size_t capacity = trace.capacity ? trace.capacity * 2 : 4096;
+        TraceEvent* events = realloc(trace.events, capacity * sizeof(TraceEvent));
+        
+        if (!events) {
+            /* Keep what fits; the run matters more than its trace */
+            pthread_mutex_unlock(&trace.lock);
+            return;
+        }
+        trace.events = events;
+        trace.capacity = capacity;
+    }
+    event = &trace.events[trace.count++];
+    event->start = start > trace.origin ? start - trace.origin : 0;
+    event->duration = end > start ? end - start : 0;
+    event->value = value;
+    event->tid = tid ? tid : trace.pid;
+    event->kind = (int16_t)kind;
+    event->count = (int16_t)count;
+    snprintf(event->name, sizeof(event->name), "%s", name);
+    pthread_mutex_unlock(&trace.lock);
+}
+
+/**
+ * Note a child's start, to record its lifetime once it is waited for
+ * @param pid: Child pid
+ * @param argv: Its arguments, for the span name
+ * @param started: When it was spawned, from monotonic_nanoseconds()
+ */
+void trace_process_started(pid_t pid, const char* const argv[], uint64_t started) {
+    const char* program = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    
+    if (!trace.path) {
+        return;
+    }
+    pthread_mutex_lock(&trace.lock);
+    for (int i = 0; i < MAX_TRACED_PROCESSES; i++) {
+        TraceProcess* process = &trace.running[i];
+        
+        if (process->pid == 0) {
+            process->pid = pid;
+            process->started = started;
+            if (strcmp(program, "git") == 0 && argv[1]) {
+                snprintf(process->name, sizeof(process->name), "git %s", argv[1]);
+            } else {
+                snprintf(process->name, sizeof(process->name), "%s", program);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trace.lock);
+}
+
+/**
+ * Record a child's lifetime, now that it has been waited for
+ * @param pid: Child pid
+ * @param status: Its exit status, or -1
+ */
+void trace_process_exited(pid_t pid, int status) {
+    uint64_t now;
+    TraceProcess process = {0};
+    
+    if (!trace.path) {
+        return;
+    }
+    now = monotonic_nanoseconds();
+    pthread_mutex_lock(&trace.lock);
+    for (int i = 0; i < MAX_TRACED_PROCESSES; i++) {
+        if (trace.running[i].pid == pid) {
+            process = trace.running[i];
+            trace.running[i].pid = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trace.lock);
+    if (process.pid) {
+        trace_add(TRACE_PROCESS, process.name, process.started, now, pid, pid, status);
+    }
+}
+
+/**
+ * Write the recorded spans as trace-event JSON; registered with atexit()
+ */
+void trace_write(void) {
+    FILE* file;
+    
+    if (!trace.path) {
+        return;
+    }
+    file = fopen(trace.path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot write trace %s: %s\n", trace.path, strerror(errno));
+        trace.path = NULL;
+        return;
+    }
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                  "\"args\": {\"name\": \"cyclops\"}}", (int)trace.pid, (int)trace.pid);
+    for (size_t i = 0; i < trace.count; i++) {
+        const TraceEvent* event = &trace.events[i];
+        
+        fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, "
+                      "\"dur\": %.3f, \"pid\": %d, \"tid\": %d", event->name,
+                trace_kind_names[event->kind], event->start / 1e3, event->duration / 1e3,
+                (int)trace.pid, (int)event->tid);
+        switch (event->kind) {
+        case TRACE_DAY:
+            fprintf(file, ", \"args\": {\"commits\": %d}}", event->count);
+            break;
+        case TRACE_COMMIT:
+            fprintf(file, ", \"args\": {\"row\": %lld, \"number\": %d}}",
+                    (long long)event->value, event->count);
+            break;
+        case TRACE_PROCESS:
+            fprintf(file, ", \"args\": {\"pid\": %lld, \"status\": %d}}",
+                    (long long)event->value, event->count);
+            break;
+        default:
+            fputc('}', file);
+            break;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error: Cannot write trace %s\n", trace.path);
+    }
+    free(trace.events);
+    trace.events = NULL;
+    trace.count = trace.capacity = 0;
+    trace.path = NULL;
+}
+
+/**
+ * Start recording spans, to be written to a file at exit
+ * @param path: Trace file
+ */
+void trace_open(const char* path) {
+    trace.path = path;
+    trace.pid = getpid();
+    trace.origin = monotonic_nanoseconds();
+    atexit(trace_write);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Processes: git started with posix_spawn, an argv array and its own env  */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * No shell is involved, so messages and paths reach git exactly as given,
+ * with no quoting and no command-length limit, and /bin/sh is not started
+ * in front of every git. glibc's posix_spawn uses vfork semantics, so a
+ * large parent's page tables are not copied for each child either.
+ */
+
+#define MAX_ERROR_LENGTH 512
+
+extern char** environ;
+
+/* Held while pipes are made and children spawned, so no child started by
+ * another thread inherits a pipe end before it is marked close-on-exec */
+pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* One git invocation: what to feed it and what came back */
+typedef struct {
+    const char* const* env;       /* Extra "NAME=value" settings, NULL terminated, or NULL */
+    const void* input;            /* Bytes for stdin; NULL gives git an empty stdin */
+    size_t input_length;
+    char* output;                 /* Buffer for stdout; NULL lets git write to ours */
+    size_t output_size;
+    size_t output_length;         /* Bytes of stdout kept, NUL terminated */
+    int status;                   /* Exit status, or -1 if git did not run */
+    char error[MAX_ERROR_LENGTH]; /* Start of git's stderr */
+} GitCall;
+
+/**
+ * Find the git executable on PATH, once per process
+ * @return: Absolute path of git, or "git" to let posix_spawnp search
+ */
+const char* git_path() {
+    static char path[MAX_PATH_LENGTH];
+    const char* search = getenv("PATH");
+    
+    while (!path[0] && search && *search) {
+        size_t length = strcspn(search, ":");
+        
+        snprintf(path, sizeof(path), "%.*s/git", (int)length, search);
+        if (length == 0 || access(path, X_OK) != 0) {
+            path[0] = '\0';
+        }
+        search += length + (search[length] == ':');
+    }
+    if (!path[0]) {
+        snprintf(path, sizeof(path), "git");
+    }
+    return path;
+}
+
+/**
+ * Create a pipe whose ends are not inherited by spawned children
+ * @param fds: Output read and write ends
+ * @return: 1 on success, 0 on failure
+ */
+int cloexec_pipe(int fds[2]) {
+    int ok;
+    
+    pthread_mutex_lock(&spawn_lock);
+    ok = pipe(fds) == 0;
+    if (ok) {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    }
+    pthread_mutex_unlock(&spawn_lock);
+    return ok;
+}
+
+/**
+ * Start a program with the given standard streams
+ * @param path: Executable; searched on PATH if it has no '/'
+ * @param argv: Arguments, NULL terminated
+ * @param env: Extra "NAME=value" settings that override ours, or NULL
+ * @param in_fd: Descriptor for the child's stdin, or -1 to share ours
+ * @param out_fd: Descriptor for the child's stdout, or -1 to share ours
+ * @param err_fd: Descriptor for the child's stderr, or -1 to share ours
+ * @return: Child pid, or -1 on failure
+ */
+pid_t spawn_process(const char* path, const char* const argv[], const char* const* env,
+                    int in_fd, int out_fd, int err_fd) {
+    posix_spawn_file_actions_t actions;
+    char** envp = environ;
+    uint64_t started = trace.path ? monotonic_nanoseconds() : 0;
+    pid_t pid;
+    int result;
+    
+    if (env && env[0]) {
+        int extra = 0, count = 0;
+        
+        while (env[extra]) {
+            extra++;
+        }
+        while (environ[count]) {
+            count++;
+        }
+        envp = malloc((extra + count + 1) * sizeof(*envp));
+        if (!envp) {
+            return -1;
+        }
+        memcpy(envp, env, extra * sizeof(*envp));
+        count = extra;
+        for (char** variable = environ; *variable; variable++) {
+            size_t name_length = strcspn(*variable, "=") + 1;
+            int overridden = 0;
+            
+            for (int i = 0; i < extra && !overridden; i++) {
+                overridden = strncmp(env[i], *variable, name_length) == 0;
+            }
+            if (!overridden) {
+                envp[count++] = *variable;
+            }
+        }
+        envp[count] = NULL;
+    }
+    
+    posix_spawn_file_actions_init(&actions);
+    if (in_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+    if (out_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    }
+    if (err_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+    }
+    pthread_mutex_lock(&spawn_lock);
+    if (strchr(path, '/')) {
+        result = posix_spawn(&pid, path, &actions, NULL, (char* const*)argv, envp);
+    } else {
+        result = posix_spawnp(&pid, path, &actions, NULL, (char* const*)argv, envp);
+    }
+    pthread_mutex_unlock(&spawn_lock);
+    posix_spawn_file_actions_destroy(&actions);
+    if (envp != environ) {
+        free(envp);
+    }
+    if (result != 0) {
+        return -1;
+    }
+    trace_process_started(pid, argv, started);
+    return pid;
+}
+
+/**
+ * Wait for a child to exit
+ * @param pid: Child pid
+ * @return: Exit status, or -1 if it did not exit normally
+ */
+int wait_process(pid_t pid) {
+    int status;
+    
+    while (waitpid(pid, &status, 0) != pid) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    trace_process_exited(pid, status);
+    return status;
+}
+
+/**
+ * Run git to completion, feeding stdin and collecting stdout and stderr
+ * @param argv: Arguments, starting with "git" and ending with NULL
+ * @param call: Input and settings; status, output and error are filled in
+ * @return: 1 if git exited with status 0, 0 otherwise
+ */
+int git_call(const char* const argv[], GitCall* call) {
+    int in[2], out[2] = {-1, -1}, err[2];
+    const char* input = call->input;
+    size_t remaining = call->input ? call->input_length : 0;
+    size_t error_length = 0;
+    struct pollfd fds[3];
+    pid_t pid;
+    
+    call->status = -1;
+    call->output_length = 0;
+    call->error[0] = '\0';
+    if (call->output && call->output_size > 0) {
+        call->output[0] = '\0';
+    }
+    if (!cloexec_pipe(in)) {
+        return 0;
+    }
+    if ((call->output && !cloexec_pipe(out)) || !cloexec_pipe(err)) {
+        close(in[0]);
+        close(in[1]);
+        if (out[0] >= 0) {
+            close(out[0]);
+            close(out[1]);
+        }
+        return 0;
+    }
+    
+    pid = spawn_process(git_path(), argv, call->env, in[0], out[1], err[1]);
+    close(in[0]);
+    if (out[1] >= 0) {
+        close(out[1]);
+    }
+    close(err[1]);
+    
+    /* A child that fills stdout or stderr must never wait on our writes */
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    fds[0].fd = remaining > 0 && pid > 0 ? in[1] : -1;
+    fds[1].fd = out[0];
+    fds[2].fd = err[0];
+    fds[0].events = POLLOUT;
+    fds[1].events = fds[2].events = POLLIN;
+    if (fds[0].fd < 0) {
+        close(in[1]);
+    }
+    while (fds[0].fd >= 0 || fds[1].fd >= 0 || fds[2].fd >= 0) {
+        char discard[4096];
+        ssize_t count;
+        
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].fd >= 0 && fds[0].revents) {
+            count = write(in[1], input, remaining);
+            if (count > 0) {
+                input += count;
+                remaining -= count;
+            }
+            if ((count < 0 && errno != EAGAIN) || remaining == 0) {
+                close(in[1]);
+                fds[0].fd = -1;
+            }
+        }
+        if (fds[1].fd >= 0 && fds[1].revents) {
+            size_t room = call->output_size - 1 - call->output_length;
+            /* Keep what fits, drain the rest so git can finish */
+            count = read(out[0], room ? call->output + call->output_length : discard,
+                         room ? room : sizeof(discard));
+            if (count > 0 && room) {
+                call->output_length += count;
+            }
+            if (count == 0 || (count < 0 && errno != EINTR)) {
+                close(out[0]);
+                fds[1].fd = -1;
+            }
+        }
+        if (fds[2].fd >= 0 && fds[2].revents) {
+            size_t room = sizeof(call->error) - 1 - error_length;
+            count = read(err[0], room ? call->error + error_length : discard,
+                         room ? room : sizeof(discard));
+            if (count > 0 && room) {
+                error_length += count;
+            }
+            if (count == 0 || (count < 0 && errno != EINTR)) {
+                close(err[0]);
+                fds[2].fd = -1;
+            }
+        }
+    }
+    if (fds[0].fd >= 0) {
+        close(in[1]);
+    }
+    if (call->output) {
+        call->output[call->output_length] = '\0';
+    }
+    call->error[error_length] = '\0';
+    
+    if (pid < 0) {
+        snprintf(call->error, sizeof(call->error), "cannot run %s\n", git_path());
+        return 0;
+    }
+    call->status = wait_process(pid);
+    return call->status == 0;
+}
+
+/**
+ * Run git for its side effects, passing on what it says if it fails
+ * @param argv: Arguments, starting with "git" and ending with NULL
+ * @return: 1 if git exited with status 0, 0 otherwise
+ */
+int run_git(const char* const argv[]) {
+    GitCall call;
+    
+    memset(&call, 0, sizeof(call));
+    if (git_call(argv, &call)) {
+        return 1;
+    }
+    fputs(call.error, stderr);
+    return 0;
+}
+
+/**
+ * Run git and capture the first line it prints
+ * @param argv: Arguments, starting with "git" and ending with NULL
+ * @param input: Bytes for git's stdin, or NULL
+ * @param length: Input size in bytes
+ * @param output: Buffer for the line, without the trailing newline
+ * @param max_length: Size of the output buffer
+ * @return: 1 if git succeeded and printed something, 0 otherwise
+ */
+int read_git_line(const char* const argv[], const void* input, size_t length,
+                  char* output, int max_length) {
+    GitCall call;
+    
+    memset(&call, 0, sizeof(call));
+    call.input = input;
+    call.input_length = length;
+    call.output = output;
+    call.output_size = max_length;
+    if (!git_call(argv, &call)) {
+        output[0] = '\0';
+        return 0;
+    }
+    output[strcspn(output, "\n")] = '\0';
+    return output[0] != '\0';
+}
+
+/**
+ * Start git with a pipe to its stdin ("w") or from its stdout ("r")
+ * @param argv: Arguments, starting with "git" and ending with NULL
+ * @param mode: "r" or "w"
+ * @param quiet: 1 to discard git's stderr
+ * @param pid: Output child pid, for git_close()
+ * @return: Stream connected to git, or NULL on failure
+ */
+FILE* git_open(const char* const argv[], const char* mode, int quiet, pid_t* pid) {
+    int reading = mode[0] == 'r';
+    int null_fd = quiet ? open("/dev/null", O_WRONLY | O_CLOEXEC) : -1;
+    int fds[2];
+    FILE* stream;
+    
+    if (!cloexec_pipe(fds)) {
+        if (null_fd >= 0) {
+            close(null_fd);
+        }
+        return NULL;
+    }
+    *pid = spawn_process(git_path(), argv, NULL, reading ? -1 : fds[0], reading ? fds[1] : -1,
+                         null_fd);
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+    close(reading ? fds[1] : fds[0]);
+    if (*pid < 0 || !(stream = fdopen(reading ? fds[0] : fds[1], mode))) {
+        close(reading ? fds[0] : fds[1]);
+        if (*pid > 0) {
+            wait_process(*pid);
+        }
+        return NULL;
+    }
+    return stream;
+}
+
+/**
+ * Close a git_open() stream and wait for git
+ * @param stream: Stream from git_open()
+ * @param pid: Child pid from git_open()
+ * @return: Exit status, or -1 if git failed to run or finish
+ */
+int git_close(FILE* stream, pid_t pid) {
+    int failed = fclose(stream) != 0;
+    int status = wait_process(pid);
+    
+    return failed ? -1 : status;
+}
+
+/*
+ * Calendar engine. Dates are handled as integer days since 1970-01-01
+ * (proleptic Gregorian) so a range is a plain integer loop whose length is
+ * known up front; Date is only used to read and print dates. The
+ * conversions follow Howard Hinnant's days_from_civil/civil_from_days and
+ * use only integer arithmetic, no per-month tables or loops.
+ */
+
+/**
+ * Convert a civil date to days since 1970-01-01
+ * @param year: Year
+ * @param month: Month (1-12)
+ * @param day: Day of the month (1-31)
+ * @return: Day number, negative before 1970
+ */
+int64_t days_from_civil(int year, int month, int day) {
+    int64_t y = (int64_t)year - (month <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t year_of_era = y - era * 400;                               /* [0, 399] */
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    
+    return era * 146097 + day_of_era - 719468;
+}
+
+/**
+ * Convert days since 1970-01-01 back to a civil date
+ * @param days: Day number, from 0000-03-01 (-719468) onwards
+ * @param date: Output date structure
+ */
+void civil_from_days(int64_t days, Date* date) {
+    /* Unsigned 32-bit math: divisions by constants become multiplications */
+    uint32_t shifted = (uint32_t)(days + 719468);                      /* From 0000-03-01 */
+    uint32_t era = shifted / 146097;
+    uint32_t day_of_era = shifted - era * 146097;                       /* [0, 146096] */
+    uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 -
+                            day_of_era / 146096) / 365;                 /* [0, 399] */
+    uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    uint32_t month_index = (5 * day_of_year + 2) / 153;                 /* March = 0 */
+    uint32_t month = month_index < 10 ? month_index + 3 : month_index - 9;
+    
+    date->day = (int)(day_of_year - (153 * month_index + 2) / 5 + 1);
+    date->month = (int)month;
+    date->year = (int)(year_of_era + era * 400 + (month <= 2));
+}
+
+/**
+ * Day of the week of a day number
+ * @param days: Day number
+ * @return: 0 for Sunday through 6 for Saturday
+ */
+int weekday_from_days(int64_t days) {
+    /* 1970-01-01 was a Thursday */
+    return (int)(days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6);
+}
+
 /**
  * Parse date string in YYYY-MM-DD format
  * @param date_str: Input date string
@@ -52,14 +755,25 @@ typedef struct {
  * @return: 1 on success, 0 on failure
  */
 int parse_date(const char* date_str, Date* date) {
+    Date check;
+    
     if (sscanf(date_str, "%d-%d-%d", &date->year, &date->month, &date->day) != 3) {
         return 0;
     }
     
     /* Basic validation */
-    if (date->year < 1900 || date->year > 2100 ||
-        date->month < 1 || date->month > 12 ||
-        date->day < 1 || date->day > 31) {
+    if (date->month < 1 || date->month > 12 || date->day < 1 || date->day > 31) {
+        return 0;
+    }
+    
+    /* Days past the end of the month (2023-02-30) do not survive a round trip */
+    civil_from_days(days_from_civil(date->year, date->month, date->day), &check);
+    if (check.day != date->day) {
+        return 0;
+    }
+    
+    /* git stores commit times as seconds since 1970 */
+    if (date->year < 1970 || date->year > 9999) {
         return 0;
     }
     
@@ -67,184 +781,4503 @@ int parse_date(const char* date_str, Date* date) {
 }
 
 /**
- * Check if a year is a leap year
- * @param year: Year to check
- * @return: 1 if leap year, 0 otherwise
+ * Parse a seed: decimal digits only, up to UINT64_MAX
+ * @param text: Input string
+ * @param seed: Output seed
+ * @return: 1 on success, 0 on failure
+ */
+int parse_seed(const char* text, uint64_t* seed) {
+    char* end;
+    
+    /* strtoull would take "", "abc" and "-1" as seeds too */
+    errno = 0;
+    *seed = strtoull(text, &end, 10);
+    return *text >= '0' && *text <= '9' && !*end && errno != ERANGE;
+}
+
+/**
+ * Initialize Git repository if it doesn't exist
+ * @return: 1 on success, 0 on failure
+ */
+int init_git_repo() {
+    struct stat st = {0};
+    char objects_dir[MAX_PATH_LENGTH];
+    
+    /* Check if the repository exists; GIT_DIR points git at bare targets */
+    snprintf(objects_dir, sizeof(objects_dir), "%s/objects", git_dir);
+    if (stat(objects_dir, &st) == -1) {
+        const char* init_argv[] = {"git", "init", NULL};
+        const char* init_bare_argv[] = {"git", "init", "-q", "--bare", NULL};
+        const char* name_argv[] = {"git", "config", "user.name", "Cyclops", NULL};
+        const char* email_argv[] = {"git", "config", "user.email", "cyclops@github.com", NULL};
+        GitCall call;
+        
+        printf("Initializing Git repository...\n");
+        if (!run_git(bare_target ? init_bare_argv : init_argv)) {
+            fprintf(stderr, "Error: Failed to initialize Git repository\n");
+            return 0;
+        }
+        
+        /* Set up initial commit; failures here are not fatal */
+        memset(&call, 0, sizeof(call));
+        git_call(name_argv, &call);
+        git_call(email_argv, &call);
+    }
+    
+    return 1;
+}
+
+/*
+ * Counter-based random numbers: every value is a pure function of
+ * (seed, date, commit number, slot), so any day can be generated on its own,
+ * in any order or thread, and a seed always reproduces the same history.
+ */
+typedef struct {
+    uint64_t seed;
+    uint32_t date;   /* YYYYMMDD */
+    uint32_t commit; /* 1-based commit number, 0 for per-day draws */
+} RandomStream;
+
+/* What each draw is used for; one independent value per slot */
+enum {
+    RANDOM_COMMIT_COUNT,
+    RANDOM_SESSION,
+    RANDOM_LINES,
+    RANDOM_MESSAGE,
+    RANDOM_HOUR,
+    RANDOM_MINUTE
+};
+
+/**
+ * SplitMix64 finalizer: a bijective 64-bit mix with full avalanche
+ * @param value: Input
+ * @return: Mixed output
+ */
+uint64_t splitmix64_mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+/**
+ * Set up the random stream for one commit (or for a whole day)
+ * @param stream: Stream to initialize
+ * @param seed: Run seed
+ * @param date: Date the draws belong to
+ * @param commit: Commit number within the day, 0 for per-day draws
+ */
+void random_stream(RandomStream* stream, uint64_t seed, const Date* date, int commit) {
+    stream->seed = seed;
+    stream->date = (uint32_t)(date->year * 10000 + date->month * 100 + date->day);
+    stream->commit = (uint32_t)commit;
+}
+
+/**
+ * Draw a uniform value in [0, bound)
+ * @param stream: Stream for the day or commit
+ * @param slot: RANDOM_* purpose of the draw
+ * @param bound: Exclusive upper bound, at least 1
+ * @return: The value
  */
-int is_leap_year(int year) {
-    return (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
+uint32_t random_below(const RandomStream* stream, int slot, uint32_t bound) {
+    uint64_t counter = (uint64_t)stream->date << 32 | (uint64_t)stream->commit << 8 | (uint64_t)slot;
+    uint64_t value = splitmix64_mix(splitmix64_mix(stream->seed) ^ (counter * 0x9e3779b97f4a7c15ULL));
+    
+    /* Multiply-shift keeps the top bits, which SplitMix mixes best */
+    return (uint32_t)(((value >> 32) * bound) >> 32);
+}
+
+/* Realistic commit messages that recruiters expect */
+const char* commit_messages[] = {
+    "Refactor authentication module",
+    "Add comprehensive unit tests",
+    "Optimize database queries",
+    "Fix memory leak in parser",
+    "Implement rate limiting middleware",
+    "Update API documentation",
+    "Add input validation layer",
+    "Improve error handling",
+    "Optimize build pipeline",
+    "Add monitoring metrics",
+    "Implement caching strategy",
+    "Fix cross-platform compatibility",
+    "Add security headers",
+    "Optimize image compression",
+    "Implement async processing",
+    "Add logging framework",
+    "Fix race condition bug",
+    "Update dependency versions",
+    "Add feature toggles",
+    "Implement data migration",
+    "Add integration tests",
+    "Fix CSS responsiveness",
+    "Optimize network requests",
+    "Add encryption support"
+};
+
+#define NUM_COMMIT_MESSAGES ((int)(sizeof(commit_messages) / sizeof(commit_messages[0])))
+
+/**
+ * Generate realistic commit messages that recruiters expect
+ * @param random: Random stream of the commit
+ * @return: Index of the message in commit_messages
+ */
+int generate_commit_message(const RandomStream* random) {
+    return random_below(random, RANDOM_MESSAGE, NUM_COMMIT_MESSAGES);
+}
+
+/* A fully generated commit, ready to be handed to a backend */
+typedef struct {
+    Date date;
+    int number;
+    int hour;
+    int minute;
+    int64_t when;    /* Seconds since the epoch */
+    int tz_offset;   /* Minutes east of UTC */
+    char path[MAX_PATH_LENGTH];
+    char entry[MAX_ENTRY_LENGTH];
+    int entry_length;
+    const char* message;
+} Commit;
+
+/*
+ * A commit backend decides how generated commits end up in the repository.
+ * init() prepares the target and is NULL for backends that have none;
+ * begin() and finish() are optional and run once per invocation;
+ * add_commit() runs once per generated commit, in date order.
+ */
+typedef struct {
+    const char* name;
+    const char* description;
+    int (*init)(void);
+    int (*begin)(void);
+    int (*add_commit)(const Commit* commit);
+    int (*finish)(void);
+} Backend;
+
+/* How activity entries are spread over files in the repository */
+typedef enum {
+    LAYOUT_SINGLE, /* Everything in DATA_FILE (default, historical layout) */
+    LAYOUT_YEAR,   /* One DATA_DIR/YYYY.txt per year */
+    LAYOUT_MONTH   /* One DATA_DIR/YYYY-MM.txt per month */
+} Layout;
+
+/* Layout names as given to --layout, by Layout value */
+const char* layout_names[] = {"single", "year", "month"};
+
+/* What --stats adds to the end of a run */
+typedef enum {
+    STATS_NONE,
+    STATS_TEXT, /* A table of phase timings under the summary */
+    STATS_JSON  /* The run report as one JSON object, printed last */
+} StatsFormat;
+
+/* Settings taken from the command line options */
+typedef struct {
+    const Backend* backend;
+    Layout layout;
+    uint64_t seed;
+    int has_seed;
+    int bulk;
+    int finalize;
+    double rate;
+    int rate_per_day;
+    int has_rate;
+    int dry_run;
+    const char* branch;
+    int checkpoint;
+    const char* git_dir;
+    const char* checkout;
+    int queue_depth;
+    int jobs;
+    const char* manifest;
+    int parallel;
+    const char* shared_objects;
+    const char* bundle;
+    int resume;
+    StatsFormat stats;
+    const char* trace;
+} Options;
+
+/**
+ * Read the name and email part of a `git var` identity
+ * @param variable: GIT_AUTHOR_IDENT or GIT_COMMITTER_IDENT
+ * @param ident: Output buffer for "Name <email>"
+ * @param max_length: Size of the output buffer
+ * @return: 1 on success, 0 on failure
+ */
+int read_git_ident(const char* variable, char* ident, int max_length) {
+    const char* argv[] = {"git", "var", variable, NULL};
+    char* end;
+    
+    if (!read_git_line(argv, NULL, 0, ident, max_length)) {
+        return 0;
+    }
+    /* Drop the trailing "<timestamp> <tz>", we supply our own dates */
+    end = strrchr(ident, '>');
+    if (!end) {
+        return 0;
+    }
+    end[1] = '\0';
+    return 1;
+}
+
+/**
+ * Work out which branch a run extends and where it currently points
+ * @param ref: Output full ref name, e.g. "refs/heads/main"
+ * @param ref_length: Size of the ref buffer
+ * @param tip: Output commit id, empty if the branch does not exist yet
+ * @param tip_length: Size of the tip buffer
+ * @param checked_out: Output, 1 if the branch is the one HEAD points at
+ * @return: 1 on success, 0 on failure
+ */
+int resolve_target(char* ref, int ref_length, char* tip, int tip_length, int* checked_out) {
+    const char* head_argv[] = {"git", "symbolic-ref", "-q", "HEAD", NULL};
+    const char* check_argv[] = {"git", "check-ref-format", ref, NULL};
+    const char* tip_argv[] = {"git", "rev-parse", "-q", "--verify", NULL, NULL};
+    char head[MAX_REF_LENGTH];
+    char spec[MAX_REF_LENGTH + 16];
+    GitCall call;
+    
+    /* Fails on a detached HEAD, which is fine when --branch names the target */
+    read_git_line(head_argv, NULL, 0, head, sizeof(head));
+    if (target_branch) {
+        snprintf(ref, ref_length, "refs/heads/%s", target_branch);
+        memset(&call, 0, sizeof(call));
+        if (!git_call(check_argv, &call)) {
+            fprintf(stderr, "Error: '%s' is not a valid branch name\n", target_branch);
+            return 0;
+        }
+    } else if (head[0]) {
+        snprintf(ref, ref_length, "%s", head);
+    } else {
+        fprintf(stderr, "Error: This backend needs a checked-out branch or --branch\n");
+        return 0;
+    }
+    *checked_out = !bare_target && strcmp(ref, head) == 0;
+    
+    /* Empty for an unborn branch: the first commit then has no parent */
+    snprintf(spec, sizeof(spec), "%s^{commit}", ref);
+    tip_argv[4] = spec;
+    read_git_line(tip_argv, NULL, 0, tip, tip_length);
+    return 1;
+}
+
+/**
+ * Format the activity log entry appended to the activity file for a commit
+ * @param entry: Output buffer
+ * @param max_length: Size of the output buffer
+ * @param date: Date of the commit
+ * @param number: Commit number within the day
+ * @param session: Minutes of development work
+ * @param lines: Lines modified
+ * @return: Length of the entry in bytes
+ */
+int format_activity_entry(char* entry, int max_length, const Date* date, int number,
+                          int session, int lines) {
+    return snprintf(entry, max_length,
+        "// Activity log: %04d-%02d-%02d #%d\n"
+        "// Session: %d minutes of development work\n"
+        "// Changes: %d lines modified\n"
+        "/* Generated activity to demonstrate the meaninglessness of GitHub metrics */\n\n",
+        date->year, date->month, date->day, number, session, lines);
+}
+
+/**
+ * Format a commit's time in git's raw date format
+ * @param commit: Commit to convert
+ * @param raw_date: Output buffer, e.g. "1704103200 +0100"
+ * @param max_length: Size of the output buffer
+ */
+void format_raw_date(const Commit* commit, char* raw_date, int max_length) {
+    int offset = commit->tz_offset;
+    
+    snprintf(raw_date, max_length, "%lld %c%02d%02d", (long long)commit->when,
+             offset < 0 ? '-' : '+', abs(offset) / 60, abs(offset) % 60);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Activity store: in-memory copies of the activity files being extended   */
+/* ---------------------------------------------------------------------- */
+
+/* One activity file; only ever appended to during a run */
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    char* content;
+    size_t length;
+    size_t capacity;
+} ActivityShard;
+
+/*
+ * Every activity file touched by this run, in date order. Dates only move
+ * forward, so a shard is complete once the next one has been opened.
+ */
+typedef struct {
+    ActivityShard* shards;
+    int count;
+    int allocated;
+    char source[41]; /* Commit to read existing files from; empty: working tree */
+    int detached;    /* The working tree is not the branch's: no source, no files */
+    /* Loads a shard's existing content; NULL means load_activity_shard() */
+    int (*load)(ActivityShard* shard, const char* source);
+} ActivityStore;
+
+/**
+ * Load an activity file into a shard
+ * @param shard: Shard whose path is set; content is filled in
+ * @param source: Commit to read the file from, or "" for the working tree
+ * @return: 1 on success, 0 on failure
+ */
+int load_activity_shard(ActivityShard* shard, const char* source) {
+    char spec[MAX_PATH_LENGTH + 48];
+    const char* argv[] = {"git", "cat-file", "blob", spec, NULL};
+    int from_git = source[0] != '\0';
+    FILE* file;
+    pid_t pid;
+    size_t read;
+    int ok = 1;
+    
+    shard->content = NULL;
+    shard->length = 0;
+    shard->capacity = 0;
+    if (from_git) {
+        snprintf(spec, sizeof(spec), "%s:%s", source, shard->path);
+        file = git_open(argv, "r", 1, &pid);
+        if (!file) {
+            return 0;
+        }
+    } else if (!(file = fopen(shard->path, "rb"))) {
+        return 1; /* Not created yet */
+    }
+    
+    /* Pipes have no size up front, so grow until everything is in */
+    do {
+        if (shard->length == shard->capacity) {
+            size_t capacity = shard->capacity ? shard->capacity * 2 : 65536;
+            char* content = realloc(shard->content, capacity);
+            if (!content) {
+                ok = 0;
+                break;
+            }
+            shard->content = content;
+            shard->capacity = capacity;
+        }
+        read = fread(shard->content + shard->length, 1, shard->capacity - shard->length, file);
+        shard->length += read;
+    } while (read > 0);
+    
+    if (!from_git) {
+        fclose(file);
+    } else if (git_close(file, pid) != 0) {
+        shard->length = 0; /* Not in that commit yet */
+    }
+    return ok;
+}
+
+/**
+ * Find the shard for a path, loading it on first use
+ * @param store: Activity store
+ * @param path: Activity file path from the commit
+ * @return: The shard, or NULL on failure
+ */
+ActivityShard* activity_shard(ActivityStore* store, const char* path) {
+    ActivityShard* shard;
+    
+    if (store->count > 0 && strcmp(store->shards[store->count - 1].path, path) == 0) {
+        return &store->shards[store->count - 1];
+    }
+    
+    if (store->count == store->allocated) {
+        int allocated = store->allocated ? store->allocated * 2 : 16;
+        ActivityShard* shards = realloc(store->shards, allocated * sizeof(*shards));
+        if (!shards) {
+            return NULL;
+        }
+        store->shards = shards;
+        store->allocated = allocated;
+    }
+    
+    shard = &store->shards[store->count];
+    snprintf(shard->path, sizeof(shard->path), "%s", path);
+    if (store->detached && !store->source[0]) {
+        /* A new branch starts from nothing, whatever lies around here */
+        shard->content = NULL;
+        shard->length = 0;
+        shard->capacity = 0;
+    } else if (!(store->load ? store->load : load_activity_shard)(shard, store->source)) {
+        fprintf(stderr, "Error: Cannot read activity file %s\n", path);
+        return NULL;
+    }
+    store->count++;
+    return shard;
+}
+
+/**
+ * Append a commit's entry to a shard
+ * @param shard: Shard to extend
+ * @param entry: Entry text
+ * @param length: Entry length in bytes
+ * @return: 1 on success, 0 on failure
+ */
+int activity_append(ActivityShard* shard, const char* entry, size_t length) {
+    size_t needed = shard->length + length;
+    
+    if (needed > shard->capacity) {
+        size_t capacity = shard->capacity ? shard->capacity : 65536;
+        char* content;
+        
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        content = realloc(shard->content, capacity);
+        if (!content) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 0;
+        }
+        shard->content = content;
+        shard->capacity = capacity;
+    }
+    memcpy(shard->content + shard->length, entry, length);
+    shard->length = needed;
+    return 1;
+}
+
+/**
+ * Write every touched shard back to the working tree
+ * @param store: Activity store
+ * @return: 1 on success, 0 on failure
+ */
+int activity_write_back(const ActivityStore* store) {
+    for (int i = 0; i < store->count; i++) {
+        const ActivityShard* shard = &store->shards[i];
+        FILE* file;
+        
+        if (strchr(shard->path, '/')) {
+            mkdir(DATA_DIR, 0777);
+        }
+        file = fopen(shard->path, "wb");
+        if (!file || fwrite(shard->content, 1, shard->length, file) != shard->length) {
+            fprintf(stderr, "Error: Cannot write activity file %s\n", shard->path);
+            if (file) {
+                fclose(file);
+            }
+            return 0;
+        }
+        fclose(file);
+    }
+    return 1;
+}
+
+/**
+ * Release all shards
+ * @param store: Activity store
+ */
+void activity_free(ActivityStore* store) {
+    for (int i = 0; i < store->count; i++) {
+        free(store->shards[i].content);
+    }
+    free(store->shards);
+    store->shards = NULL;
+    store->count = 0;
+    store->allocated = 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Journal: what a run has published, so --resume can carry on from there  */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Append-only, one line per event, in the target's git directory:
+ *
+ *   run <seed> <start> <end> <max> <layout> <first row> <ref> <tip or ->
+ *   commit <row> <date> <number> <tip>
+ *   checkpoint <row>
+ *   done
+ *
+ * The run line holds everything needed to rebuild the plan, and where the
+ * branch was when the run started. The random stream of a commit is a pure
+ * function of the seed, date and number (see RandomStream), so those are
+ * the whole generator state. Backends that hash their own commits add a
+ * commit line just before they move the branch. fast-import works out the
+ * ids itself and keeps going through what is already in its pipe if we die,
+ * so it gets a checkpoint line before the branch may move and a commit line
+ * once it has. --resume takes the newest line of the last run whose tip is
+ * where the branch points now: a line for a move that never happened is
+ * simply never matched, and the branch only ever holds whole commits. If
+ * none matches, a checkpoint line counts once git confirms the branch is
+ * exactly that many commits past the last known tip.
+ */
+
+#define JOURNAL_FILE "cyclops-journal"
+
+typedef struct {
+    FILE* file;
+    char plan[MAX_COMMAND_LENGTH]; /* The run line up to the ref */
+    int64_t row;                   /* Plan row being committed */
+    Date date;
+    int number;
+} Journal;
+
+Journal journal;
+
+/* Where the last run in a journal got to */
+typedef struct {
+    uint64_t seed;
+    char start[16];
+    char end[16];
+    int max_commits_per_day;
+    Layout layout;
+    char ref[MAX_REF_LENGTH];
+    int64_t row; /* Next plan row to commit, -1 if the branch matches no line */
+    int complete;
+} JournalResume;
+
+/**
+ * Open the journal for appending; nothing is written until journal_begin
+ * @param dir: Git directory of the target
+ * @param plan: Seed, dates, max, layout and first row, as on the run line
+ * @return: 1 on success, 0 on failure
+ */
+int journal_open(const char* dir, const char* plan) {
+    char path[MAX_PATH_LENGTH + 32];
+    
+    snprintf(path, sizeof(path), "%s/%s", dir, JOURNAL_FILE);
+    journal.file = fopen(path, "a");
+    if (!journal.file) {
+        fprintf(stderr, "Error: Cannot open %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    fcntl(fileno(journal.file), F_SETFD, FD_CLOEXEC);
+    snprintf(journal.plan, sizeof(journal.plan), "%s", plan);
+    return 1;
+}
+
+/**
+ * Make everything written so far survive a crash of the whole machine
+ * @return: 1 on success, 0 on failure
+ */
+int journal_sync() {
+    if (fflush(journal.file) != 0 || fsync(fileno(journal.file)) != 0) {
+        fprintf(stderr, "Error: Cannot write the journal: %s\n", strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Write the run line, once the backend knows the branch and its tip
+ * @param ref: Full ref name of the branch
+ * @param tip: Current tip, empty for an unborn branch
+ * @return: 1 on success, 0 on failure
+ */
+int journal_begin(const char* ref, const char* tip) {
+    if (!journal.file) {
+        return 1;
+    }
+    fprintf(journal.file, "run %s %s %s\n", journal.plan, ref, tip[0] ? tip : "-");
+    return journal_sync();
+}
+
+/**
+ * Note the plan row about to be committed
+ * @param row: Plan row
+ * @param commit: Its commit
+ */
+void journal_next(int64_t row, const Commit* commit) {
+    journal.row = row;
+    journal.date = commit->date;
+    journal.number = commit->number;
+}
+
+/**
+ * Record that the branch points (or is about to point) at the commit of
+ * the current row; synced every time, so it comes before the branch moves
+ * @param hex: Commit id
+ * @return: 1 on success, 0 on failure
+ */
+int journal_record(const char* hex) {
+    if (!journal.file) {
+        return 1;
+    }
+    fprintf(journal.file, "commit %lld %04d-%02d-%02d %d %s\n", (long long)journal.row,
+            journal.date.year, journal.date.month, journal.date.day, journal.number, hex);
+    return journal_sync();
+}
+
+/**
+ * Record that the branch may move to the commit of the current row, which
+ * only git knows the id of yet
+ * @return: 1 on success, 0 on failure
+ */
+int journal_pending() {
+    if (!journal.file) {
+        return 1;
+    }
+    fprintf(journal.file, "checkpoint %lld\n", (long long)journal.row);
+    return journal_sync();
+}
+
+/**
+ * Close the journal
+ * @param complete: 1 if every row of the plan was committed
+ * @return: 1 on success, 0 on failure
+ */
+int journal_close(int complete) {
+    int ok;
+    
+    if (!journal.file) {
+        return 1;
+    }
+    if (complete) {
+        fputs("done\n", journal.file);
+    }
+    ok = journal_sync();
+    ok &= fclose(journal.file) == 0;
+    journal.file = NULL;
+    return ok;
+}
+
+/**
+ * Find where the last run in the journal got to, by where its branch
+ * points now; no history is read
+ * @param dir: Git directory of the target
+ * @param resume: Output plan and next row
+ * @return: 1 on success, 0 if there is nothing that can be resumed
+ */
+int journal_read(const char* dir, JournalResume* resume) {
+    const char* tip_argv[] = {"git", "rev-parse", "-q", "--verify", NULL, NULL};
+    const char* count_argv[] = {"git", "rev-list", "--count", NULL, NULL};
+    char path[MAX_PATH_LENGTH + 32];
+    char line[MAX_COMMAND_LENGTH + MAX_REF_LENGTH];
+    char spec[MAX_REF_LENGTH + 64];
+    char layout[16], tip[41], current[41], known[41], count[32];
+    unsigned long long seed;
+    long long row;
+    int64_t known_next, pending = -1;
+    long run = -1;
+    long offset;
+    FILE* file;
+    int found = 0;
+    
+    memset(resume, 0, sizeof(*resume));
+    snprintf(path, sizeof(path), "%s/%s", dir, JOURNAL_FILE);
+    file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Nothing to resume, %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    /* Only the last run counts */
+    while ((offset = ftell(file)) >= 0 && fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "run ", 4) == 0) {
+            run = offset;
+        }
+    }
+    fseek(file, run < 0 ? 0 : run, SEEK_SET);
+    if (run < 0 || !fgets(line, sizeof(line), file) ||
+        sscanf(line, "run %llu %15s %15s %d %15s %lld %255s %40s", &seed, resume->start,
+               resume->end, &resume->max_commits_per_day, layout, &row, resume->ref, tip) != 8) {
+        fprintf(stderr, "Error: %s has no readable run\n", path);
+        fclose(file);
+        return 0;
+    }
+    resume->seed = seed;
+    resume->row = -1;
+    for (int i = 0; i < (int)(sizeof(layout_names) / sizeof(layout_names[0])); i++) {
+        if (strcmp(layout, layout_names[i]) == 0) {
+            resume->layout = (Layout)i;
+            found = 1;
+        }
+    }
+    if (!found || strncmp(resume->ref, "refs/heads/", 11) != 0) {
+        fprintf(stderr, "Error: %s has no readable run\n", path);
+        fclose(file);
+        return 0;
+    }
+    
+    snprintf(spec, sizeof(spec), "%s^{commit}", resume->ref);
+    tip_argv[4] = spec;
+    if (!read_git_line(tip_argv, NULL, 0, current, sizeof(current))) {
+        snprintf(current, sizeof(current), "-");
+    }
+    if (strcmp(tip, current) == 0) {
+        resume->row = row;
+    }
+    memcpy(known, tip, sizeof(known));
+    known_next = row;
+    while (fgets(line, sizeof(line), file)) {
+        char date[16];
+        int number;
+        
+        if (sscanf(line, "commit %lld %15s %d %40s", &row, date, &number, tip) == 4) {
+            if (strcmp(tip, current) == 0) {
+                resume->row = row + 1;
+            }
+            memcpy(known, tip, sizeof(known));
+            known_next = row + 1;
+            pending = -1;
+        } else if (sscanf(line, "checkpoint %lld", &row) == 1) {
+            pending = row;
+        } else if (strcmp(line, "done\n") == 0) {
+            resume->complete = 1;
+        }
+    }
+    fclose(file);
+    
+    /* fast-import moved the branch but died before saying where to */
+    if (!resume->complete && resume->row < 0 && pending >= 0) {
+        if (strcmp(known, "-") == 0) {
+            snprintf(spec, sizeof(spec), "%s", resume->ref);
+        } else {
+            snprintf(spec, sizeof(spec), "%s..%s", known, resume->ref);
+        }
+        count_argv[3] = spec;
+        if (read_git_line(count_argv, NULL, 0, count, sizeof(count)) &&
+            atoll(count) == pending + 1 - known_next) {
+            resume->row = pending + 1;
+        }
+    }
+    
+    if (!resume->complete && resume->row < 0) {
+        fprintf(stderr, "Error: %s has moved since the last run in %s; not resuming\n",
+                resume->ref, path);
+        return 0;
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Stats: per-phase commit timings in log-bucketed histograms (--stats)    */
+/* ---------------------------------------------------------------------- */
+
+/* Parts of a commit timed separately; a backend skips the ones it lacks */
+typedef enum {
+    PHASE_ENTRY,  /* Expanding the plan row and formatting its entry */
+    PHASE_APPEND, /* Appending the entry to the activity file */
+    PHASE_ADD,    /* Hashing and storing the file's new version (git add) */
+    PHASE_COMMIT, /* Trees and the commit itself (git commit) */
+    PHASE_REF,    /* Moving the branch to a new commit */
+    PHASE_COUNT
+} Phase;
+
+/* Phase names in reports, by Phase value */
+const char* phase_names[] = {"entry", "append", "add", "commit", "ref"};
+
+/*
+ * Every power of two is split into 1 << HISTOGRAM_SUB_BITS buckets, so a
+ * bucket is at most 1/8 of its values wide at any scale: values below 8 ns
+ * get a bucket each, 1000-1023 ns share one and 1.0-1.07 s share another.
+ * 496 buckets cover the whole uint64_t range.
+ */
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t total; /* Nanoseconds */
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+typedef struct {
+    int enabled;                   /* Set by --stats and --trace */
+    Phase phase;                   /* Phase being timed, PHASE_COUNT if none */
+    uint64_t started;
+    uint64_t pending[PHASE_COUNT]; /* Time per phase of the current commit */
+    unsigned ran;                  /* Bit per phase the current commit went through */
+    Histogram phases[PHASE_COUNT];
+    Histogram commits;             /* Whole commits as the main loop saw them, on every run */
+} Stats;
+
+Stats stats = {0, PHASE_COUNT};
+
+/**
+ * Find the bucket a value falls in
+ * @param value: Nanoseconds
+ * @return: Bucket index
+ */
+int histogram_bucket(uint64_t value) {
+    int exponent;
+    
+    if (value < (1 << HISTOGRAM_SUB_BITS)) {
+        return (int)value;
+    }
+    exponent = 63 - __builtin_clzll(value);
+    return ((exponent - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+           (int)((value >> (exponent - HISTOGRAM_SUB_BITS)) & ((1 << HISTOGRAM_SUB_BITS) - 1));
+}
+
+/**
+ * Largest value that falls in a bucket
+ * @param bucket: Bucket index
+ * @return: Nanoseconds
+ */
+uint64_t histogram_bucket_top(int bucket) {
+    int shift;
+    
+    if (bucket < (1 << HISTOGRAM_SUB_BITS)) {
+        return (uint64_t)bucket;
+    }
+    shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    return (((uint64_t)(bucket & ((1 << HISTOGRAM_SUB_BITS) - 1)) + (1 << HISTOGRAM_SUB_BITS) + 1)
+            << shift) - 1;
+}
+
+/**
+ * Count one value
+ * @param histogram: Histogram to add to
+ * @param value: Nanoseconds
+ */
+void histogram_add(Histogram* histogram, uint64_t value) {
+    histogram->count++;
+    histogram->total += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->buckets[histogram_bucket(value)]++;
+}
+
+/**
+ * Read a percentile off a histogram, to within its bucket
+ * @param histogram: Histogram to read
+ * @param share: Percentile as a fraction, 0 to 1
+ * @return: Top of the bucket holding that rank, at most the largest value
+ *          seen; 0 if the histogram is empty
+ */
+uint64_t histogram_percentile(const Histogram* histogram, double share) {
+    uint64_t rank = (uint64_t)(share * histogram->count);
+    uint64_t seen = 0;
+    
+    /* The smallest value with at least that share of the sample at or below it */
+    if (rank < share * histogram->count || rank < 1) {
+        rank++;
+    }
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS && histogram->count > 0; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            uint64_t top = histogram_bucket_top(bucket);
+            return top < histogram->max ? top : histogram->max;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Move the current commit's clock to another phase
+ * @param phase: Phase starting now, PHASE_COUNT to stop timing
+ * @return: The phase that was being timed, to hand back to afterwards
+ */
+Phase stats_phase(Phase phase) {
+    Phase previous = stats.phase;
+    uint64_t now;
+    
+    if (!stats.enabled) {
+        return PHASE_COUNT;
+    }
+    now = monotonic_nanoseconds();
+    if (previous != PHASE_COUNT) {
+        stats.pending[previous] += now - stats.started;
+        stats.ran |= 1u << previous;
+        trace_add(TRACE_PHASE, phase_names[previous], stats.started, now, 0, 0, 0);
+    }
+    stats.phase = phase;
+    stats.started = now;
+    return previous;
+}
+
+/**
+ * Stop timing and count the phases gone through since the last call
+ */
+void stats_record() {
+    if (!stats.enabled) {
+        return;
+    }
+    stats_phase(PHASE_COUNT);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        if (stats.ran & (1u << phase)) {
+            histogram_add(&stats.phases[phase], stats.pending[phase]);
+        }
+        stats.pending[phase] = 0;
+    }
+    stats.ran = 0;
+}
+
+/**
+ * Print a histogram's summary as a JSON object, in microseconds
+ * @param file: Output stream
+ * @param histogram: Histogram to print
+ */
+void print_histogram_json(FILE* file, const Histogram* histogram) {
+    fprintf(file, "{\"count\": %llu, \"total_us\": %.1f, \"mean_us\": %.2f, \"p50_us\": %.2f, "
+                  "\"p90_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}",
+            (unsigned long long)histogram->count, histogram->total / 1e3,
+            histogram->count ? histogram->total / 1e3 / histogram->count : 0.0,
+            histogram_percentile(histogram, 0.50) / 1e3,
+            histogram_percentile(histogram, 0.90) / 1e3,
+            histogram_percentile(histogram, 0.99) / 1e3, histogram->max / 1e3);
+}
+
+/**
+ * Print one row of the --stats table
+ * @param name: Row label
+ * @param histogram: Histogram to print
+ */
+void print_histogram_row(const char* name, const Histogram* histogram) {
+    printf("  %-8s %9llu %11.1f %9.1f %9.1f %9.1f %9.1f\n", name,
+           (unsigned long long)histogram->count, histogram->total / 1e6,
+           histogram_percentile(histogram, 0.50) / 1e3,
+           histogram_percentile(histogram, 0.90) / 1e3,
+           histogram_percentile(histogram, 0.99) / 1e3, histogram->max / 1e3);
+}
+
+/**
+ * Print the phase table for --stats=text
+ */
+void print_stats_text() {
+    printf("\nPhase timings (main thread):\n");
+    printf("  %-8s %9s %11s %9s %9s %9s %9s\n", "phase", "count", "total ms", "p50 us",
+           "p90 us", "p99 us", "max us");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        print_histogram_row(phase_names[phase], &stats.phases[phase]);
+    }
+    print_histogram_row("total", &stats.commits);
+}
+
+/**
+ * Print the run report for --stats=json, as a single line
+ * @param file: Output stream
+ * @param backend: Backend name
+ * @param seed: Run seed
+ * @param days: Days processed
+ * @param active_days: Days processed that had commits
+ * @param commits: Commits created
+ * @param seconds: Time from the first commit to the end of finish()
+ * @param peak_rss: Peak resident set of cyclops, in KiB
+ * @param git_rss: Peak resident set of the largest git child, in KiB; 0 if
+ *                 none was waited for, reported as null
+ */
+void print_stats_json(FILE* file, const char* backend, uint64_t seed, int64_t days,
+                      int64_t active_days, int64_t commits, double seconds, long peak_rss,
+                      long git_rss) {
+    fprintf(file, "{\"backend\": \"%s\", \"seed\": %llu, \"days\": %lld, \"active_days\": %lld, "
+                  "\"commits\": %lld, \"seconds\": %.6f, \"commits_per_second\": %.1f, "
+                  "\"average_commits_per_day\": %.3f, \"average_commits_per_active_day\": %.3f, "
+                  "\"peak_rss_kib\": %ld, \"git_peak_rss_kib\": ",
+            backend, (unsigned long long)seed, (long long)days, (long long)active_days,
+            (long long)commits, seconds, seconds > 0 ? commits / seconds : 0.0,
+            days > 0 ? (double)commits / days : 0.0,
+            active_days > 0 ? (double)commits / active_days : 0.0, peak_rss);
+    if (git_rss > 0) {
+        fprintf(file, "%ld, \"total\": ", git_rss);
+    } else {
+        fprintf(file, "null, \"total\": ");
+    }
+    print_histogram_json(file, &stats.commits);
+    fprintf(file, ", \"phases\": {");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        fprintf(file, "%s\"%s\": ", phase > 0 ? ", " : "", phase_names[phase]);
+        print_histogram_json(file, &stats.phases[phase]);
+    }
+    fprintf(file, "}}\n");
+}
+
+/* ---------------------------------------------------------------------- */
+/* Porcelain backend: one `git add` and one `git commit` per commit        */
+/* ---------------------------------------------------------------------- */
+
+/**
+ * Append the entry to the activity file, then git add and git commit it
+ * @param commit: Commit to record
+ * @return: 1 on success, 0 on failure
+ */
+int porcelain_add_commit(const Commit* commit) {
+    char raw_date[MAX_DATE_LENGTH];
+    char author_date[MAX_DATE_LENGTH + 32];
+    char committer_date[MAX_DATE_LENGTH + 32];
+    const char* env[] = {author_date, committer_date, NULL};
+    const char* add_argv[] = {"git", "add", "--", commit->path, NULL};
+    const char* commit_argv[] = {"git", "commit", "-q", "-m", commit->message, NULL};
+    GitCall call;
+    FILE* file;
+    
+    /* Create/update the activity file with realistic content */
+    stats_phase(PHASE_APPEND);
+    if (strchr(commit->path, '/')) {
+        mkdir(DATA_DIR, 0777);
+    }
+    file = fopen(commit->path, "a");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open activity file\n");
+        return 0;
+    }
+    fwrite(commit->entry, 1, commit->entry_length, file);
+    fclose(file);
+    
+    /* Add file to git */
+    stats_phase(PHASE_ADD);
+    if (!run_git(add_argv)) {
+        fprintf(stderr, "Error: Failed to add file to git\n");
+        return 0;
+    }
+    
+    /* Raw dates leave git nothing to parse or guess */
+    stats_phase(PHASE_COMMIT);
+    format_raw_date(commit, raw_date, sizeof(raw_date));
+    snprintf(author_date, sizeof(author_date), "GIT_AUTHOR_DATE=%s", raw_date);
+    snprintf(committer_date, sizeof(committer_date), "GIT_COMMITTER_DATE=%s", raw_date);
+    
+    memset(&call, 0, sizeof(call));
+    call.env = env;
+    if (!git_call(commit_argv, &call)) {
+        fprintf(stderr, "%sError: Failed to create commit\n", call.error);
+        return 0;
+    }
+    
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Fast-import backend: one long-lived `git fast-import` for the whole run */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Activity files are kept in memory and the changed one is streamed as a
+ * new blob for every commit; fast-import reuses the unchanged tree entries.
+ * The working tree copies are written once, after fast-import has accepted
+ * the whole stream.
+ */
+typedef struct {
+    FILE* stream;
+    FILE* replies; /* fast-import's stdout, where progress lines come back */
+    char ref[MAX_REF_LENGTH];
+    char parent[41];
+    char author[MAX_IDENT_LENGTH];
+    char committer[MAX_IDENT_LENGTH];
+    ActivityStore activity;
+    int mark;
+    int checked_out;
+    pid_t pid;
+} FastImport;
+
+FastImport fast_import;
+
+/**
+ * Resolve the target branch and identity, then start git fast-import
+ * @return: 1 on success, 0 on failure
+ */
+int fast_import_begin() {
+    const char* argv[] = {"git", "fast-import", "--quiet", "--done", "--date-format=raw", NULL};
+    int to_git[2], from_git[2];
+    
+    if (!resolve_target(fast_import.ref, sizeof(fast_import.ref), fast_import.parent,
+                        sizeof(fast_import.parent), &fast_import.checked_out) ||
+        !journal_begin(fast_import.ref, fast_import.parent)) {
+        return 0;
+    }
+    if (!fast_import.checked_out || resuming) {
+        /* Extend the branch's own files, not whatever is checked out */
+        snprintf(fast_import.activity.source, sizeof(fast_import.activity.source), "%s",
+                 fast_import.parent);
+        fast_import.activity.detached = 1;
+    }
+    
+    if (!read_git_ident("GIT_AUTHOR_IDENT", fast_import.author, sizeof(fast_import.author)) ||
+        !read_git_ident("GIT_COMMITTER_IDENT", fast_import.committer,
+                        sizeof(fast_import.committer))) {
+        fprintf(stderr, "Error: Cannot determine git identity\n");
+        return 0;
+    }
+    
+    if (!cloexec_pipe(to_git)) {
+        return 0;
+    }
+    if (!cloexec_pipe(from_git)) {
+        close(to_git[0]);
+        close(to_git[1]);
+        return 0;
+    }
+    fast_import.pid = spawn_process(git_path(), argv, NULL, to_git[0], from_git[1], -1);
+    close(to_git[0]);
+    close(from_git[1]);
+    fast_import.stream = fdopen(to_git[1], "w");
+    fast_import.replies = fdopen(from_git[0], "r");
+    if (fast_import.pid < 0 || !fast_import.stream || !fast_import.replies) {
+        fprintf(stderr, "Error: Failed to start git fast-import\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Journal where fast-import has put the branch; it works out the commit
+ * ids itself, so this asks git once the branch has moved
+ * @return: 1 on success, 0 on failure
+ */
+int fast_import_record() {
+    const char* tip_argv[] = {"git", "rev-parse", "-q", "--verify", fast_import.ref, NULL};
+    char tip[41];
+    
+    if (!journal.file) {
+        return 1;
+    }
+    if (!read_git_line(tip_argv, NULL, 0, tip, sizeof(tip))) {
+        fprintf(stderr, "Error: Cannot read %s after git fast-import\n", fast_import.ref);
+        return 0;
+    }
+    return journal_record(tip);
+}
+
+/**
+ * Stream the updated activity blob and its commit to fast-import
+ * @param commit: Commit to record
+ * @return: 1 on success, 0 on failure
+ */
+int fast_import_add_commit(const Commit* commit) {
+    FILE* stream = fast_import.stream;
+    char raw_date[MAX_DATE_LENGTH];
+    ActivityShard* shard;
+    
+    stats_phase(PHASE_APPEND);
+    shard = activity_shard(&fast_import.activity, commit->path);
+    if (!shard || !activity_append(shard, commit->entry, commit->entry_length)) {
+        return 0;
+    }
+    
+    stats_phase(PHASE_ADD);
+    fast_import.mark++;
+    fprintf(stream, "blob\nmark :%d\ndata %zu\n", fast_import.mark, shard->length);
+    fwrite(shard->content, 1, shard->length, stream);
+    
+    stats_phase(PHASE_COMMIT);
+    format_raw_date(commit, raw_date, sizeof(raw_date));
+    fprintf(stream, "\ncommit %s\n", fast_import.ref);
+    fprintf(stream, "author %s %s\n", fast_import.author, raw_date);
+    fprintf(stream, "committer %s %s\n", fast_import.committer, raw_date);
+    fprintf(stream, "data %zu\n%s\n", strlen(commit->message) + 1, commit->message);
+    if (fast_import.parent[0]) {
+        /* fast-import only continues branches it created itself */
+        fprintf(stream, "from %s\n", fast_import.parent);
+        fast_import.parent[0] = '\0';
+    }
+    fprintf(stream, "M 100644 :%d %s\n\n", fast_import.mark, commit->path);
+    if (checkpoint_interval > 0 && fast_import.mark % checkpoint_interval == 0) {
+        /* Makes fast-import flush its pack and update the branch now; the
+         * progress line comes back once it has */
+        char line[64];
+        
+        stats_phase(PHASE_REF);
+        if (!journal_pending()) {
+            return 0;
+        }
+        fputs("checkpoint\n\n", stream);
+        if (journal.file) {
+            fputs("progress checkpoint\n\n", stream);
+            fflush(stream);
+            if (!fgets(line, sizeof(line), fast_import.replies)) {
+                fprintf(stderr, "Error: git fast-import did not finish its checkpoint\n");
+                return 0;
+            }
+            if (!fast_import_record()) {
+                return 0;
+            }
+        }
+    }
+    
+    if (ferror(stream)) {
+        fprintf(stderr, "Error: git fast-import stopped accepting input\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Close the stream, then sync the working tree files and index if the
+ * branch is checked out
+ * @return: 1 on success, 0 on failure
+ */
+int fast_import_finish() {
+    const char* reset_argv[] = {"git", "reset", "-q", "--", DATA_FILE, DATA_DIR, NULL};
+    /* A resumed run holds only the files it touched; the others may still be
+     * where the run that died left them. The pattern matches both layouts */
+    const char* restore_argv[] = {"git", "checkout", "-q", "HEAD", "--", DATA_DIR "*", NULL};
+    Phase previous = stats_phase(PHASE_REF);
+    int status;
+    
+    if (fast_import.mark > 0 && !journal_pending()) {
+        return 0;
+    }
+    fputs("done\n", fast_import.stream);
+    status = git_close(fast_import.stream, fast_import.pid);
+    fclose(fast_import.replies);
+    fast_import.stream = NULL;
+    fast_import.replies = NULL;
+    if (status != 0) {
+        fprintf(stderr, "Error: git fast-import failed\n");
+        return 0;
+    }
+    if (fast_import.mark > 0 && !fast_import_record()) {
+        return 0;
+    }
+    stats_phase(previous);
+    
+    if (fast_import.mark > 0 && fast_import.checked_out) {
+        /* Bring the working tree and index in line with the new HEAD */
+        if (!activity_write_back(&fast_import.activity)) {
+            return 0;
+        }
+        if (!run_git(resuming ? restore_argv : reset_argv)) {
+            fprintf(stderr, "Error: Failed to refresh the index\n");
+            return 0;
+        }
+    }
+    
+    activity_free(&fast_import.activity);
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* SHA-1, for naming git objects                                           */
+/* ---------------------------------------------------------------------- */
+
+typedef struct {
+    uint32_t state[5];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t used;
+} Sha1;
+
+#define SHA1_ROL(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+/**
+ * Run the SHA-1 compression function over one 64-byte block
+ * @param state: Hash state to update
+ * @param block: Block to absorb
+ */
+void sha1_block(uint32_t state[5], const unsigned char* block) {
+    uint32_t w[80];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = SHA1_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k, temp;
+        
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        temp = SHA1_ROL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = SHA1_ROL(b, 30);
+        b = a;
+        a = temp;
+    }
+    
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+/**
+ * Start a new SHA-1 computation
+ * @param sha: Hash context
+ */
+void sha1_init(Sha1* sha) {
+    sha->state[0] = 0x67452301;
+    sha->state[1] = 0xefcdab89;
+    sha->state[2] = 0x98badcfe;
+    sha->state[3] = 0x10325476;
+    sha->state[4] = 0xc3d2e1f0;
+    sha->length = 0;
+    sha->used = 0;
+}
+
+/**
+ * Feed bytes into a SHA-1 computation
+ * @param sha: Hash context
+ * @param data: Bytes to absorb
+ * @param length: Number of bytes
+ */
+void sha1_update(Sha1* sha, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    
+    sha->length += length;
+    if (sha->used) {
+        size_t take = 64 - sha->used < length ? 64 - sha->used : length;
+        memcpy(sha->buffer + sha->used, bytes, take);
+        sha->used += take;
+        bytes += take;
+        length -= take;
+        if (sha->used < 64) {
+            return;
+        }
+        sha1_block(sha->state, sha->buffer);
+        sha->used = 0;
+    }
+    while (length >= 64) {
+        sha1_block(sha->state, bytes);
+        bytes += 64;
+        length -= 64;
+    }
+    memcpy(sha->buffer, bytes, length);
+    sha->used = length;
+}
+
+/**
+ * Finish a SHA-1 computation
+ * @param sha: Hash context
+ * @param digest: Output 20-byte digest
+ */
+void sha1_final(Sha1* sha, unsigned char digest[20]) {
+    uint64_t bits = sha->length * 8;
+    unsigned char padding[72] = {0x80};
+    size_t pad = (sha->used < 56 ? 56 : 120) - sha->used;
+    
+    for (int i = 0; i < 8; i++) {
+        padding[pad + i] = (unsigned char)(bits >> (56 - i * 8));
+    }
+    sha1_update(sha, padding, pad + 8);
+    for (int i = 0; i < 20; i++) {
+        digest[i] = (unsigned char)(sha->state[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+/**
+ * Format an object id as 40 hex digits
+ * @param sha: Binary object id
+ * @param hex: Output buffer of at least 41 bytes
+ */
+void sha1_to_hex(const unsigned char* sha, char* hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 20; i++) {
+        hex[i * 2] = digits[sha[i] >> 4];
+        hex[i * 2 + 1] = digits[sha[i] & 15];
+    }
+    hex[40] = '\0';
+}
+
+/**
+ * Parse 40 hex digits into an object id
+ * @param hex: Hex string
+ * @param sha: Output binary object id
+ * @return: 1 on success, 0 on failure
+ */
+int hex_to_sha1(const char* hex, unsigned char* sha) {
+    for (int i = 0; i < 20; i++) {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) {
+            return 0;
+        }
+        sha[i] = (unsigned char)byte;
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Loose objects: zlib-deflated "<type> <size>\0<data>" under objects/     */
+/* ---------------------------------------------------------------------- */
+
+/**
+ * Hash an object the way git names it
+ * @param type: "blob", "tree" or "commit"
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Output object id
+ */
+void hash_object(const char* type, const void* data, size_t length, unsigned char* sha) {
+    char header[64];
+    int header_length = snprintf(header, sizeof(header), "%s %zu", type, length) + 1;
+    Sha1 ctx;
+    
+    sha1_init(&ctx);
+    sha1_update(&ctx, header, header_length);
+    sha1_update(&ctx, data, length);
+    sha1_final(&ctx, sha);
+}
+
+/* Room for a file name under object_dir */
+#define OBJECT_PATH_LENGTH (MAX_PATH_LENGTH + 64)
+
+/* Objects found in the shared store instead of being stored again */
+_Atomic int64_t shared_hits;
+_Atomic int64_t shared_bytes;
+
+/**
+ * Look for an object in the shared store before storing it, and count it
+ * if it is there
+ * @param sha: Object id
+ * @return: 1 if the store has it as a loose object, 0 if not or no store
+ */
+int shared_object_present(const unsigned char* sha) {
+    char hex[41];
+    char path[OBJECT_PATH_LENGTH];
+    struct stat st;
+    
+    if (!shared_objects) {
+        return 0;
+    }
+    sha1_to_hex(sha, hex);
+    snprintf(path, sizeof(path), "%s/%.2s/%s", shared_objects, hex, hex + 2);
+    if (stat(path, &st) != 0) {
+        return 0;
+    }
+    atomic_fetch_add(&shared_hits, 1);
+    atomic_fetch_add(&shared_bytes, (int64_t)st.st_size);
+    return 1;
+}
+
+/**
+ * Hash and store one loose object, unless it already exists
+ * @param type: "blob", "tree" or "commit"
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Output object id
+ * @return: 1 on success, 0 on failure
+ */
+int write_loose_object(const char* type, const void* data, size_t length, unsigned char* sha) {
+    char header[64];
+    int header_length = snprintf(header, sizeof(header), "%s %zu", type, length) + 1;
+    char hex[41];
+    char path[OBJECT_PATH_LENGTH];
+    char temp_path[OBJECT_PATH_LENGTH];
+    unsigned char out[65536];
+    z_stream zs;
+    FILE* file;
+    int fd;
+    int status;
+    int failed;
+    
+    hash_object(type, data, length, sha);
+    sha1_to_hex(sha, hex);
+    snprintf(path, sizeof(path), "%s/%.2s/%s", object_dir, hex, hex + 2);
+    if (shared_object_present(sha) || access(path, F_OK) == 0) {
+        return 1;
+    }
+    
+    snprintf(temp_path, sizeof(temp_path), "%s/%.2s", object_dir, hex);
+    mkdir(temp_path, 0777);
+    snprintf(temp_path, sizeof(temp_path), "%s/%.2s/tmp_obj_XXXXXX", object_dir, hex);
+    fd = mkstemp(temp_path);
+    if (fd < 0 || !(file = fdopen(fd, "wb"))) {
+        fprintf(stderr, "Error: Cannot create object file in %s\n", object_dir);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    
+    memset(&zs, 0, sizeof(zs));
+    deflateInit(&zs, Z_BEST_SPEED); /* git's core.looseCompression default */
+    zs.next_in = (unsigned char*)header;
+    zs.avail_in = header_length;
+    do {
+        zs.next_out = out;
+        zs.avail_out = sizeof(out);
+        deflate(&zs, Z_NO_FLUSH);
+        fwrite(out, 1, sizeof(out) - zs.avail_out, file);
+    } while (zs.avail_in > 0);
+    zs.next_in = (unsigned char*)data;
+    zs.avail_in = length;
+    do {
+        zs.next_out = out;
+        zs.avail_out = sizeof(out);
+        status = deflate(&zs, Z_FINISH);
+        fwrite(out, 1, sizeof(out) - zs.avail_out, file);
+    } while (status == Z_OK);
+    deflateEnd(&zs);
+    
+    failed = status != Z_STREAM_END || ferror(file);
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp_path, path) != 0) {
+        fprintf(stderr, "Error: Cannot write object %s\n", hex);
+        unlink(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Point the target and every git started from here at a shared object
+ * store: the target lists it in objects/info/alternates, new objects go
+ * into it, and the target's own objects stay visible during the run
+ * @param dir: Store directory, created if missing
+ * @return: 1 on success, 0 on failure
+ */
+int setup_shared_objects(const char* dir) {
+    char path[OBJECT_PATH_LENGTH];
+    char line[OBJECT_PATH_LENGTH];
+    char name[32];
+    char* store;
+    char* local;
+    FILE* file;
+    int listed = 0;
+    int count;
+    
+    mkdir(dir, 0777);
+    if (!(store = realpath(dir, NULL))) {
+        fprintf(stderr, "Error: Cannot use %s as an object store\n", dir);
+        return 0;
+    }
+    snprintf(object_dir, sizeof(object_dir), "%s", store);
+    free(store);
+    snprintf(path, sizeof(path), "%s/pack", object_dir);
+    mkdir(path, 0777);
+    snprintf(path, sizeof(path), "%s/info", object_dir);
+    mkdir(path, 0777);
+    
+    /* Alternates are read as absolute paths, so the target works on its own */
+    snprintf(path, sizeof(path), "%s/objects/info", git_dir);
+    mkdir(path, 0777);
+    snprintf(path, sizeof(path), "%s/objects/info/alternates", git_dir);
+    if ((file = fopen(path, "r"))) {
+        while (!listed && fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\n")] = '\0';
+            listed = strcmp(line, object_dir) == 0;
+        }
+        fclose(file);
+    }
+    if (!listed && (!(file = fopen(path, "a")) || fprintf(file, "%s\n", object_dir) < 0 ||
+                    fclose(file) != 0)) {
+        fprintf(stderr, "Error: Cannot write %s\n", path);
+        return 0;
+    }
+    
+    snprintf(path, sizeof(path), "%s/objects", git_dir);
+    if (!(local = realpath(path, NULL))) {
+        fprintf(stderr, "Error: Cannot find %s\n", path);
+        return 0;
+    }
+    setenv("GIT_OBJECT_DIRECTORY", object_dir, 1);
+    setenv("GIT_ALTERNATE_OBJECT_DIRECTORIES", local, 1);
+    free(local);
+    
+    /* An automatic gc from here would take the store for this target's own
+     * and prune what other targets use */
+    count = getenv("GIT_CONFIG_COUNT") ? atoi(getenv("GIT_CONFIG_COUNT")) : 0;
+    snprintf(name, sizeof(name), "GIT_CONFIG_KEY_%d", count);
+    setenv(name, "gc.auto", 1);
+    snprintf(name, sizeof(name), "GIT_CONFIG_VALUE_%d", count);
+    setenv(name, "0", 1);
+    snprintf(name, sizeof(name), "%d", count + 1);
+    setenv("GIT_CONFIG_COUNT", name, 1);
+    
+    shared_objects = object_dir;
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Trees held in memory, so each commit only rehashes what changed         */
+/* ---------------------------------------------------------------------- */
+
+/* Stores one object of a given type and reports its id */
+typedef int (*ObjectWriter)(const char* type, const void* data, size_t length, unsigned char* sha);
+
+/* One version of an activity file: the previous version plus a tail */
+typedef struct {
+    int file;               /* Index of the file in its store, stable for the run */
+    const char* content;
+    size_t length;
+    size_t previous_length; /* Length of the version stored before this one */
+    int hashed;             /* Set if sha already holds the blob id */
+    unsigned char sha[20];
+} BlobVersion;
+
+/* Stores an activity file version as a blob and reports its id */
+typedef int (*BlobWriter)(const BlobVersion* blob, unsigned char* sha);
+
+/**
+ * Get a blob version's id, hashing it unless that was already done
+ * @param blob: Activity file version
+ * @param sha: Output blob id
+ */
+void blob_id(const BlobVersion* blob, unsigned char* sha) {
+    if (blob->hashed) {
+        memcpy(sha, blob->sha, 20);
+    } else {
+        hash_object("blob", blob->content, blob->length, sha);
+    }
+}
+
+#define MODE_FILE 0100644
+#define MODE_TREE 040000
+
+typedef struct {
+    char name[MAX_PATH_LENGTH];
+    unsigned int mode;
+    unsigned char sha[20];
+} TreeEntry;
+
+typedef struct {
+    TreeEntry* entries;
+    int count;
+    int allocated;
+} Tree;
+
+/**
+ * Compare two tree entries the way git sorts them
+ * (directories compare as if their name ended in '/')
+ * @return: <0, 0 or >0 like strcmp
+ */
+int tree_entry_compare(const char* name1, unsigned int mode1,
+                       const char* name2, unsigned int mode2) {
+    size_t length1 = strlen(name1), length2 = strlen(name2);
+    size_t common = length1 < length2 ? length1 : length2;
+    int result = memcmp(name1, name2, common);
+    unsigned char c1, c2;
+    
+    if (result) {
+        return result;
+    }
+    c1 = name1[common] ? (unsigned char)name1[common] : (mode1 == MODE_TREE ? '/' : 0);
+    c2 = name2[common] ? (unsigned char)name2[common] : (mode2 == MODE_TREE ? '/' : 0);
+    return c1 - c2;
+}
+
+/**
+ * Add or replace an entry, keeping the tree in git order
+ * @param tree: Tree to modify
+ * @param name: Entry name (a single path component)
+ * @param mode: MODE_FILE or MODE_TREE (other modes are passed through)
+ * @param sha: Object id the entry points at
+ * @return: 1 on success, 0 on failure
+ */
+int tree_set(Tree* tree, const char* name, unsigned int mode, const unsigned char* sha) {
+    int position = 0;
+    
+    for (; position < tree->count; position++) {
+        int order;
+        if (strcmp(tree->entries[position].name, name) == 0) {
+            tree->entries[position].mode = mode;
+            memcpy(tree->entries[position].sha, sha, 20);
+            return 1;
+        }
+        order = tree_entry_compare(tree->entries[position].name, tree->entries[position].mode,
+                                   name, mode);
+        if (order > 0) {
+            break;
+        }
+    }
+    
+    if (tree->count == tree->allocated) {
+        int allocated = tree->allocated ? tree->allocated * 2 : 16;
+        TreeEntry* entries = realloc(tree->entries, allocated * sizeof(*entries));
+        if (!entries) {
+            return 0;
+        }
+        tree->entries = entries;
+        tree->allocated = allocated;
+    }
+    memmove(&tree->entries[position + 1], &tree->entries[position],
+            (tree->count - position) * sizeof(*tree->entries));
+    snprintf(tree->entries[position].name, MAX_PATH_LENGTH, "%s", name);
+    tree->entries[position].mode = mode;
+    memcpy(tree->entries[position].sha, sha, 20);
+    tree->count++;
+    return 1;
+}
+
+/**
+ * Find an entry by name
+ * @param tree: Tree to search
+ * @param name: Entry name
+ * @return: The entry, or NULL if there is none
+ */
+const TreeEntry* tree_find(const Tree* tree, const char* name) {
+    for (int i = 0; i < tree->count; i++) {
+        if (strcmp(tree->entries[i].name, name) == 0) {
+            return &tree->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Load a tree from the repository with `git ls-tree`
+ * @param treeish: Anything git accepts as a tree, e.g. a commit id
+ * @param tree: Tree to fill in
+ * @return: 1 on success, 0 on failure
+ */
+int load_tree(const char* treeish, Tree* tree) {
+    const char* argv[] = {"git", "ls-tree", "-z", treeish, NULL};
+    char* line = NULL;
+    size_t line_size = 0;
+    FILE* pipe;
+    pid_t pid;
+    int ok = 1;
+    
+    pipe = git_open(argv, "r", 0, &pid);
+    if (!pipe) {
+        return 0;
+    }
+    /* "<mode> <type> <hex>\t<name>" records, NUL terminated */
+    while (ok && getdelim(&line, &line_size, '\0', pipe) > 0) {
+        char* tab = strchr(line, '\t');
+        char* hex = strchr(line, ' ') ? strchr(strchr(line, ' ') + 1, ' ') : NULL;
+        unsigned char sha[20];
+        
+        ok = tab && hex && hex_to_sha1(hex + 1, sha) &&
+             tree_set(tree, tab + 1, (unsigned int)strtoul(line, NULL, 8), sha);
+    }
+    free(line);
+    return git_close(pipe, pid) == 0 && ok;
+}
+
+/**
+ * Serialize a tree and hand it to an object writer
+ * @param tree: Tree to store
+ * @param write_object: Object writer
+ * @param sha: Output tree id
+ * @return: 1 on success, 0 on failure
+ */
+int write_tree(const Tree* tree, ObjectWriter write_object, unsigned char* sha) {
+    char* buffer = malloc((size_t)tree->count * (MAX_PATH_LENGTH + 32) + 1);
+    size_t length = 0;
+    int ok;
+    
+    if (!buffer) {
+        return 0;
+    }
+    for (int i = 0; i < tree->count; i++) {
+        length += sprintf(buffer + length, "%o %s", tree->entries[i].mode,
+                          tree->entries[i].name) + 1;
+        memcpy(buffer + length, tree->entries[i].sha, 20);
+        length += 20;
+    }
+    ok = write_object("tree", buffer, length, sha);
+    free(buffer);
+    return ok;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Pipeline: hash on the main thread, store on a writer thread             */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * The plan already fixes every commit, so the stages left are generating
+ * a commit's objects (entries, trees, the commit, their ids) and storing
+ * them (deflate and write, or a round trip to git). Object ids are all the
+ * next commit needs, so the main thread computes them itself and hands the
+ * objects to a writer thread through a single-producer single-consumer
+ * ring; it only waits when the ring is full or before the branch moves.
+ * Blobs are passed by pointer into the activity content, which only grows:
+ * the bytes a queued version covers never change, and the buffer is only
+ * reallocated once the ring is empty.
+ */
+
+#define DEFAULT_QUEUE_DEPTH 256
+#define MAX_QUEUE_DEPTH 65536
+
+/* One queued object; blobs point at the activity content, the rest are copied */
+typedef struct {
+    const char* type;      /* "tree" or "commit"; NULL for a blob version */
+    char* data;
+    size_t length;
+    size_t capacity;
+    BlobVersion blob;
+    unsigned char sha[20]; /* Id the producer computed, checked by the writer */
+} ObjectSlot;
+
+typedef struct {
+    ObjectSlot* slots;
+    size_t mask;               /* Slot count - 1; the count is a power of two */
+    _Atomic size_t head;       /* Next slot to fill, moved only by the producer */
+    _Atomic size_t tail;       /* Next slot to store, moved only by the writer */
+    _Atomic int closed;
+    _Atomic int failed;
+    pthread_t thread;
+    int running;
+    ObjectWriter write_object; /* The backend's own writers */
+    BlobWriter write_blob;
+    size_t objects;
+    double started;
+    double stopped;
+    double stalled;            /* Producer time waiting for a free slot */
+    double drained;            /* Producer time waiting for the ring to empty */
+    double busy;               /* Writer time spent storing */
+} Pipeline;
+
+Pipeline pipeline;
+
+/* Polls before a waiting thread yields; 0 with a single CPU, where spinning
+ * only delays the thread being waited for */
+int spin_limit = 0;
+
+/**
+ * Read a monotonic clock
+ * @return: Seconds since an arbitrary fixed point
+ */
+double monotonic_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Wait a little for another thread: spin, then yield, then sleep
+ * @param spins: Times waited so far for the same condition
+ */
+void pause_thread(int* spins) {
+    struct timespec pause = {0, 50000};
+    
+    if (++*spins < spin_limit) {
+        return;
+    }
+    if (*spins < spin_limit + 64) {
+        sched_yield();
+        return;
+    }
+    nanosleep(&pause, NULL);
+}
+
+/**
+ * Writer thread: store queued objects in order until the ring is closed
+ * @param unused: Unused
+ * @return: NULL
+ */
+void* pipeline_thread(void* unused) {
+    sigset_t signals;
+    int spins = 0;
+    
+    /* Interrupts are for the main thread, which stops at a commit boundary */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    
+    for (;;) {
+        size_t tail = atomic_load_explicit(&pipeline.tail, memory_order_relaxed);
+        ObjectSlot* slot;
+        unsigned char sha[20];
+        double started;
+        int ok;
+        
+        if (tail == atomic_load_explicit(&pipeline.head, memory_order_acquire)) {
+            /* The last object is published before the ring is closed */
+            if (atomic_load_explicit(&pipeline.closed, memory_order_acquire) &&
+                tail == atomic_load_explicit(&pipeline.head, memory_order_acquire)) {
+                break;
+            }
+            pause_thread(&spins);
+            continue;
+        }
+        spins = 0;
+        
+        slot = &pipeline.slots[tail & pipeline.mask];
+        /* After a failure the rest is skipped; the producer stops queueing */
+        if (!atomic_load_explicit(&pipeline.failed, memory_order_relaxed)) {
+            started = monotonic_seconds();
+            ok = slot->type ? pipeline.write_object(slot->type, slot->data, slot->length, sha)
+                            : pipeline.write_blob(&slot->blob, sha);
+            pipeline.busy += monotonic_seconds() - started;
+            if (ok && memcmp(sha, slot->sha, 20) != 0) {
+                fprintf(stderr, "Error: Stored object id differs from the computed one\n");
+                ok = 0;
+            }
+            if (!ok) {
+                atomic_store_explicit(&pipeline.failed, 1, memory_order_relaxed);
+            }
+        }
+        atomic_store_explicit(&pipeline.tail, tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * Claim the next free slot, waiting while the ring is full
+ * @return: Slot to fill, or NULL if the writer has failed
+ */
+ObjectSlot* pipeline_claim() {
+    size_t head = atomic_load_explicit(&pipeline.head, memory_order_relaxed);
+    double started = 0;
+    int spins = 0;
+    
+    while (head - atomic_load_explicit(&pipeline.tail, memory_order_acquire) > pipeline.mask) {
+        if (atomic_load_explicit(&pipeline.failed, memory_order_relaxed)) {
+            return NULL;
+        }
+        if (spins == 0) {
+            started = monotonic_seconds();
+        }
+        pause_thread(&spins);
+    }
+    if (spins > 0) {
+        pipeline.stalled += monotonic_seconds() - started;
+    }
+    if (atomic_load_explicit(&pipeline.failed, memory_order_relaxed)) {
+        return NULL;
+    }
+    return &pipeline.slots[head & pipeline.mask];
+}
+
+/**
+ * Hand a filled slot to the writer
+ */
+void pipeline_publish() {
+    size_t head = atomic_load_explicit(&pipeline.head, memory_order_relaxed);
+    
+    pipeline.objects++;
+    atomic_store_explicit(&pipeline.head, head + 1, memory_order_release);
+}
+
+/**
+ * Object writer that hashes now and queues a copy for the writer thread
+ * @param type: Object type, a string constant
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Output object id
+ * @return: 1 on success, 0 on failure
+ */
+int pipeline_write_object(const char* type, const void* data, size_t length, unsigned char* sha) {
+    ObjectSlot* slot;
+    
+    hash_object(type, data, length, sha);
+    if (!(slot = pipeline_claim())) {
+        return 0;
+    }
+    if (length > slot->capacity) {
+        char* copy = realloc(slot->data, length);
+        if (!copy) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 0;
+        }
+        slot->data = copy;
+        slot->capacity = length;
+    }
+    memcpy(slot->data, data, length);
+    slot->type = type;
+    slot->length = length;
+    memcpy(slot->sha, sha, 20);
+    pipeline_publish();
+    return 1;
+}
+
+/**
+ * Blob writer that hashes now and queues the version for the writer thread
+ * @param blob: Activity file version; its content must stay put until stored
+ * @param sha: Output blob id
+ * @return: 1 on success, 0 on failure
+ */
+int pipeline_write_blob(const BlobVersion* blob, unsigned char* sha) {
+    ObjectSlot* slot;
+    
+    blob_id(blob, sha);
+    if (!(slot = pipeline_claim())) {
+        return 0;
+    }
+    slot->type = NULL;
+    slot->blob = *blob;
+    slot->blob.hashed = 1;
+    memcpy(slot->blob.sha, sha, 20);
+    memcpy(slot->sha, sha, 20);
+    pipeline_publish();
+    return 1;
+}
+
+/**
+ * Put the pipeline in front of a backend's writers, if --queue-depth allows
+ * @param write_object: Object writer, replaced by the queueing one
+ * @param write_blob: Blob writer, replaced by the queueing one
+ * @return: 1 on success, 0 on failure
+ */
+int pipeline_start(ObjectWriter* write_object, BlobWriter* write_blob) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t slots = 1;
+    
+    /* With one CPU the stages only take turns, and handing over costs */
+    if (queue_depth < 0) {
+        queue_depth = cpus > 1 ? DEFAULT_QUEUE_DEPTH : 0;
+    }
+    if (queue_depth == 0) {
+        return 1;
+    }
+    while (slots < (size_t)queue_depth) {
+        slots *= 2;
+    }
+    pipeline.slots = calloc(slots, sizeof(*pipeline.slots));
+    if (!pipeline.slots) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+    pipeline.mask = slots - 1;
+    spin_limit = cpus > 1 ? 64 : 0;
+    pipeline.write_object = *write_object;
+    pipeline.write_blob = *write_blob;
+    pipeline.started = monotonic_seconds();
+    if (pthread_create(&pipeline.thread, NULL, pipeline_thread, NULL) != 0) {
+        fprintf(stderr, "Error: Cannot start the writer thread\n");
+        free(pipeline.slots);
+        return 0;
+    }
+    pipeline.running = 1;
+    *write_object = pipeline_write_object;
+    *write_blob = pipeline_write_blob;
+    return 1;
+}
+
+/**
+ * Wait until every queued object is stored
+ * @return: 1 if all were stored, 0 if the writer failed
+ */
+int pipeline_drain() {
+    size_t head = atomic_load_explicit(&pipeline.head, memory_order_relaxed);
+    double started;
+    int spins = 0;
+    
+    if (!pipeline.running) {
+        return !atomic_load(&pipeline.failed);
+    }
+    started = monotonic_seconds();
+    while (atomic_load_explicit(&pipeline.tail, memory_order_acquire) != head) {
+        pause_thread(&spins);
+    }
+    pipeline.drained += monotonic_seconds() - started;
+    return !atomic_load(&pipeline.failed);
+}
+
+/**
+ * Store whatever is queued and stop the writer thread
+ * @return: 1 if every object was stored, 0 if the writer failed
+ */
+int pipeline_stop() {
+    if (pipeline.running) {
+        double started = monotonic_seconds();
+        
+        atomic_store_explicit(&pipeline.closed, 1, memory_order_release);
+        pthread_join(pipeline.thread, NULL);
+        pipeline.stopped = monotonic_seconds();
+        pipeline.drained += pipeline.stopped - started;
+        pipeline.running = 0;
+        for (size_t i = 0; i <= pipeline.mask; i++) {
+            free(pipeline.slots[i].data);
+        }
+        free(pipeline.slots);
+        pipeline.slots = NULL;
+    }
+    return !atomic_load(&pipeline.failed);
+}
+
+/**
+ * Print how busy each stage was while the pipeline ran
+ */
+void pipeline_report() {
+    double wall = pipeline.stopped - pipeline.started;
+    double waiting = pipeline.stalled + pipeline.drained;
+    
+    if (pipeline.objects == 0 || wall <= 0) {
+        return;
+    }
+    printf("Pipeline: %zu objects through %zu slots in %.2fs\n",
+           pipeline.objects, pipeline.mask + 1, wall);
+    printf("  generate  busy %5.1f%%  (%.2fs waiting on a full queue, %.2fs on stores)\n",
+           100.0 * (wall - waiting) / wall, pipeline.stalled, pipeline.drained);
+    printf("  store     busy %5.1f%%  (%.2fs idle on an empty queue)\n",
+           100.0 * pipeline.busy / wall, wall - pipeline.busy);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Workers: hash and store upcoming blobs on a thread pool (--jobs)        */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Commits have to be chained one after the other, but every blob is fixed
+ * by the plan: version k of a file is its start plus the first k of its
+ * entries. So the main thread appends entries for the next rows of the plan
+ * as soon as a slot is free, and the workers hash those versions (and store
+ * them, where the backend's blob writer is safe to run concurrently) while
+ * it builds the trees and commits of earlier rows. The ids come back per
+ * row, in plan order, so the objects are the same as with one thread. Trees
+ * stay with the commits: each depends on the blob ids just computed and is
+ * a few hundred bytes, where a blob is the whole file.
+ */
+
+#define WORKER_LOOKAHEAD 256 /* Rows prepared ahead of the commits; a power of two */
+#define MAX_JOBS 64
+
+enum { JOB_QUEUED, JOB_DONE, JOB_FAILED };
+
+typedef struct {
+    BlobVersion blob;
+    _Atomic int state;
+} BlobJob;
+
+typedef struct {
+    BlobJob jobs[WORKER_LOOKAHEAD];
+    _Atomic size_t published; /* Jobs handed out so far, one per plan row */
+    _Atomic size_t claimed;   /* Jobs taken by a thread so far */
+    size_t consumed;          /* Jobs whose commit is written */
+    _Atomic int closed;
+    pthread_t threads[MAX_JOBS];
+    int count;
+    int running;
+    ActivityStore* activity;
+    BlobWriter write_blob;    /* Stores blobs on the workers, or NULL to only hash */
+} Workers;
+
+Workers workers;
+
+/**
+ * Take the oldest unclaimed job and run it on the calling thread
+ * @return: 1 if a job was run, 0 if none was waiting
+ */
+int workers_run_one() {
+    size_t index = atomic_load_explicit(&workers.claimed, memory_order_relaxed);
+    
+    while (index < atomic_load_explicit(&workers.published, memory_order_acquire)) {
+        if (atomic_compare_exchange_weak(&workers.claimed, &index, index + 1)) {
+            BlobJob* job = &workers.jobs[index % WORKER_LOOKAHEAD];
+            int ok = 1;
+            
+            if (workers.write_blob) {
+                ok = workers.write_blob(&job->blob, job->blob.sha);
+            } else {
+                hash_object("blob", job->blob.content, job->blob.length, job->blob.sha);
+            }
+            job->blob.hashed = ok;
+            atomic_store_explicit(&job->state, ok ? JOB_DONE : JOB_FAILED, memory_order_release);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Worker thread: run jobs until the pool is closed
+ * @param unused: Unused
+ * @return: NULL
+ */
+void* workers_thread(void* unused) {
+    sigset_t signals;
+    int spins = 0;
+    
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    
+    while (!atomic_load_explicit(&workers.closed, memory_order_acquire)) {
+        if (workers_run_one()) {
+            spins = 0;
+        } else {
+            pause_thread(&spins);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Start the pool, if --jobs asks for more than the main thread
+ * @param activity: Store the activity files live in
+ * @param write_blob: Blob writer safe to call from several threads, or
+ *                    NULL if blobs must be stored in order by the caller
+ * @return: 1 on success, 0 on failure
+ */
+int workers_start(ActivityStore* activity, BlobWriter write_blob) {
+    if (hash_jobs <= 1) {
+        return 1;
+    }
+    workers.activity = activity;
+    workers.write_blob = write_blob;
+    spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 64 : 0;
+    /* The main thread runs jobs too while it waits for one */
+    for (workers.count = 0; workers.count < hash_jobs - 1; workers.count++) {
+        if (pthread_create(&workers.threads[workers.count], NULL, workers_thread, NULL) != 0) {
+            fprintf(stderr, "Error: Cannot start worker thread\n");
+            break;
+        }
+    }
+    workers.running = workers.count > 0;
+    return workers.count == hash_jobs - 1;
+}
+
+/**
+ * Run or wait for every job handed out so far
+ */
+void workers_settle() {
+    size_t published = atomic_load_explicit(&workers.published, memory_order_relaxed);
+    int spins = 0;
+    
+    for (size_t index = workers.consumed; index < published; index++) {
+        BlobJob* job = &workers.jobs[index % WORKER_LOOKAHEAD];
+        
+        while (atomic_load_explicit(&job->state, memory_order_acquire) == JOB_QUEUED) {
+            if (!workers_run_one()) {
+                pause_thread(&spins);
+            }
+        }
+    }
+}
+
+/**
+ * Start handing out jobs at a later plan row; only before the first submit
+ * @param row: First plan row of the run
+ */
+void workers_seek(size_t row) {
+    atomic_store(&workers.published, row);
+    atomic_store(&workers.claimed, row);
+    workers.consumed = row;
+}
+
+/**
+ * Whether another row can be prepared ahead of the commits
+ * @return: 1 if a job slot is free
+ */
+int workers_have_room() {
+    return workers.running &&
+           atomic_load_explicit(&workers.published, memory_order_relaxed) - workers.consumed <
+           WORKER_LOOKAHEAD;
+}
+
+/**
+ * Append the next row's entry to its activity file and queue the new version
+ * @param commit: Next commit of the plan not handed out yet
+ * @return: 1 on success, 0 on failure
+ */
+int workers_submit(const Commit* commit) {
+    size_t index = atomic_load_explicit(&workers.published, memory_order_relaxed);
+    BlobJob* job = &workers.jobs[index % WORKER_LOOKAHEAD];
+    ActivityShard* shard = activity_shard(workers.activity, commit->path);
+    
+    if (!shard) {
+        return 0;
+    }
+    /* Jobs and queued objects point into the content; let them finish
+     * before it moves */
+    if (shard->length + commit->entry_length > shard->capacity) {
+        workers_settle();
+        if (!pipeline_drain()) {
+            return 0;
+        }
+    }
+    job->blob.file = (int)(shard - workers.activity->shards);
+    job->blob.previous_length = shard->length;
+    if (!activity_append(shard, commit->entry, commit->entry_length)) {
+        return 0;
+    }
+    job->blob.content = shard->content;
+    job->blob.length = shard->length;
+    job->blob.hashed = 0;
+    atomic_store_explicit(&job->state, JOB_QUEUED, memory_order_relaxed);
+    atomic_store_explicit(&workers.published, index + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * Take the blob of the next commit, running jobs while it is not ready
+ * @param blob: Output version, with its id
+ * @return: 1 on success, 0 if it could not be hashed or stored
+ */
+int workers_take(BlobVersion* blob) {
+    BlobJob* job = &workers.jobs[workers.consumed % WORKER_LOOKAHEAD];
+    int spins = 0;
+    int state;
+    
+    while ((state = atomic_load_explicit(&job->state, memory_order_acquire)) == JOB_QUEUED) {
+        if (!workers_run_one()) {
+            pause_thread(&spins);
+        }
+    }
+    if (state == JOB_FAILED) {
+        return 0;
+    }
+    *blob = job->blob;
+    /* The content may have moved since, with the same bytes */
+    blob->content = workers.activity->shards[blob->file].content;
+    workers.consumed++;
+    return 1;
+}
+
+/**
+ * Stop the pool and drop the entries of rows that never got their commit
+ */
+void workers_stop() {
+    size_t published = atomic_load_explicit(&workers.published, memory_order_relaxed);
+    
+    if (!workers.running) {
+        return;
+    }
+    atomic_store_explicit(&workers.closed, 1, memory_order_release);
+    for (int i = 0; i < workers.count; i++) {
+        pthread_join(workers.threads[i], NULL);
+    }
+    workers.running = 0;
+    /* Newest first, so each file ends at its oldest unused version's base */
+    for (size_t index = published; index > workers.consumed; index--) {
+        const BlobJob* job = &workers.jobs[(index - 1) % WORKER_LOOKAHEAD];
+        workers.activity->shards[job->blob.file].length = job->blob.previous_length;
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Objects backend: write loose objects in-process, update the ref once    */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * The root tree (and the DATA_DIR subtree for sharded layouts) stay in
+ * memory; each commit hashes one new blob, the one or two small trees above
+ * it, and the commit itself. Where the objects go is up to write_object and
+ * write_blob, so the pack backend can reuse all of this.
+ */
+typedef struct {
+    char ref[MAX_REF_LENGTH];
+    char old_tip[41];
+    unsigned char tip[20];
+    int has_tip;
+    char author[MAX_IDENT_LENGTH];
+    char committer[MAX_IDENT_LENGTH];
+    Tree root;
+    Tree data_dir;
+    ActivityStore activity;
+    int commits;
+    int checked_out;
+    int checkpoint;
+    int standalone; /* No repository: the history starts empty, the ref is preset */
+    ObjectWriter write_object;
+    BlobWriter write_blob;
+    /* Moves ref from old_hex to new_hex once every object is stored */
+    int (*update_ref)(const char* ref, const char* new_hex, const char* old_hex);
+} ObjectBackend;
+
+ObjectBackend objects;
+
+/**
+ * Store a new activity file version as a loose blob, always whole
+ * @param blob: Activity file version
+ * @param sha: Output blob id
+ * @return: 1 on success, 0 on failure
+ */
+int loose_write_blob(const BlobVersion* blob, unsigned char* sha) {
+    return write_loose_object("blob", blob->content, blob->length, sha);
+}
+
+/**
+ * Move a ref with git update-ref
+ * @param ref: Full ref name
+ * @param new_hex: New commit id
+ * @param old_hex: Expected current value; all zeros if it must not exist
+ * @return: 1 on success, 0 on failure
+ */
+int git_update_ref(const char* ref, const char* new_hex, const char* old_hex) {
+    const char* argv[] = {"git", "update-ref", "-m", "cyclops", ref, new_hex, old_hex, NULL};
+    return run_git(argv);
+}
+
+/**
+ * Resolve the target branch, its tip and tree, and the commit identity,
+ * then start the worker pool and put the pipeline in front of the writers.
+ * Standalone backends set objects.ref (and may set the identity) first
+ * @param write_object: Where trees and commits are stored
+ * @param write_blob: Where activity file versions are stored
+ * @param concurrent_blobs: 1 if write_blob may run on several threads at once
+ * @return: 1 on success, 0 on failure
+ */
+int objects_begin(ObjectWriter write_object, BlobWriter write_blob, int concurrent_blobs) {
+    const TreeEntry* entry;
+    char hex[41];
+    
+    objects.write_object = write_object;
+    objects.write_blob = write_blob;
+    objects.update_ref = git_update_ref;
+    objects.checkpoint = checkpoint_interval;
+    
+    if (!objects.standalone && !resolve_target(objects.ref, sizeof(objects.ref), objects.old_tip,
+                                               sizeof(objects.old_tip), &objects.checked_out)) {
+        return 0;
+    }
+    if (!journal_begin(objects.ref, objects.old_tip)) {
+        return 0;
+    }
+    if (objects.old_tip[0]) {
+        if (!hex_to_sha1(objects.old_tip, objects.tip) || !load_tree(objects.old_tip, &objects.root)) {
+            fprintf(stderr, "Error: Cannot read the tree of %s\n", objects.ref);
+            return 0;
+        }
+        objects.has_tip = 1;
+    }
+    if (!objects.checked_out || resuming) {
+        /* Extend the branch's own files, not whatever is checked out */
+        memcpy(objects.activity.source, objects.old_tip, sizeof(objects.old_tip));
+        objects.activity.detached = 1;
+    }
+    
+    entry = tree_find(&objects.root, DATA_DIR);
+    if (entry && entry->mode == MODE_TREE) {
+        sha1_to_hex(entry->sha, hex);
+        if (!load_tree(hex, &objects.data_dir)) {
+            fprintf(stderr, "Error: Cannot read %s from %s\n", DATA_DIR, objects.ref);
+            return 0;
+        }
+    }
+    
+    /* The caller may have set the identity already */
+    if (!objects.author[0] &&
+        (!read_git_ident("GIT_AUTHOR_IDENT", objects.author, sizeof(objects.author)) ||
+         !read_git_ident("GIT_COMMITTER_IDENT", objects.committer, sizeof(objects.committer)))) {
+        if (!objects.standalone) {
+            fprintf(stderr, "Error: Cannot determine git identity\n");
+            return 0;
+        }
+        /* Nowhere to configure one: use what init_git_repo gives new repositories */
+        snprintf(objects.author, sizeof(objects.author), "Cyclops <cyclops@github.com>");
+        snprintf(objects.committer, sizeof(objects.committer), "Cyclops <cyclops@github.com>");
+    }
+    return workers_start(&objects.activity, concurrent_blobs ? write_blob : NULL) &&
+           pipeline_start(&objects.write_object, &objects.write_blob);
+}
+
+/**
+ * Start the objects backend with loose objects
+ * @return: 1 on success, 0 on failure
+ */
+int loose_begin() {
+    return objects_begin(write_loose_object, loose_write_blob, 1);
+}
+
+/**
+ * Move the branch from its last known value to the current tip
+ * @return: 1 on success, 0 on failure
+ */
+int objects_update_ref() {
+    Phase previous = stats_phase(PHASE_REF);
+    char hex[41];
+    
+    /* Every object the new tip reaches must be stored first */
+    if (!pipeline_drain()) {
+        return 0;
+    }
+    sha1_to_hex(objects.tip, hex);
+    if (!journal_record(hex)) {
+        return 0;
+    }
+    /* The old value makes the update fail if someone moved the branch */
+    if (!objects.update_ref(objects.ref, hex, objects.old_tip[0] ? objects.old_tip
+                            : "0000000000000000000000000000000000000000")) {
+        fprintf(stderr, "Error: Failed to update %s\n", objects.ref);
+        return 0;
+    }
+    memcpy(objects.old_tip, hex, sizeof(hex));
+    stats_phase(previous);
+    return 1;
+}
+
+/**
+ * Hash the changed blob, the trees above it and the commit
+ * @param commit: Commit to record
+ * @return: 1 on success, 0 on failure
+ */
+int objects_add_commit(const Commit* commit) {
+    char buffer[MAX_IDENT_LENGTH * 2 + MAX_MESSAGE_LENGTH + 256];
+    char raw_date[MAX_DATE_LENGTH];
+    char hex[41];
+    unsigned char sha[20];
+    const char* slash = strchr(commit->path, '/');
+    BlobVersion blob;
+    int length;
+    
+    if (workers.running) {
+        /* Appended and hashed ahead, and stored too if the writer allows */
+        stats_phase(PHASE_ADD);
+        if (!workers_take(&blob)) {
+            return 0;
+        }
+        memcpy(sha, blob.sha, 20);
+        if (!workers.write_blob && !objects.write_blob(&blob, sha)) {
+            return 0;
+        }
+    } else {
+        ActivityShard* shard;
+        
+        stats_phase(PHASE_APPEND);
+        shard = activity_shard(&objects.activity, commit->path);
+        if (!shard) {
+            return 0;
+        }
+        /* Queued versions point into the content, so it may only move once
+         * they are stored; doubling keeps that rare */
+        if (shard->length + commit->entry_length > shard->capacity && !pipeline_drain()) {
+            return 0;
+        }
+        blob.file = (int)(shard - objects.activity.shards);
+        blob.previous_length = shard->length;
+        if (!activity_append(shard, commit->entry, commit->entry_length)) {
+            return 0;
+        }
+        blob.content = shard->content;
+        blob.length = shard->length;
+        blob.hashed = 0;
+        stats_phase(PHASE_ADD);
+        if (!objects.write_blob(&blob, sha)) {
+            return 0;
+        }
+    }
+    
+    stats_phase(PHASE_COMMIT);
+    if (slash) {
+        if (!tree_set(&objects.data_dir, slash + 1, MODE_FILE, sha) ||
+            !write_tree(&objects.data_dir, objects.write_object, sha) ||
+            !tree_set(&objects.root, DATA_DIR, MODE_TREE, sha)) {
+            return 0;
+        }
+    } else if (!tree_set(&objects.root, commit->path, MODE_FILE, sha)) {
+        return 0;
+    }
+    if (!write_tree(&objects.root, objects.write_object, sha)) {
+        return 0;
+    }
+    
+    format_raw_date(commit, raw_date, sizeof(raw_date));
+    sha1_to_hex(sha, hex);
+    length = snprintf(buffer, sizeof(buffer), "tree %s\n", hex);
+    if (objects.has_tip) {
+        sha1_to_hex(objects.tip, hex);
+        length += snprintf(buffer + length, sizeof(buffer) - length, "parent %s\n", hex);
+    }
+    length += snprintf(buffer + length, sizeof(buffer) - length,
+                       "author %s %s\ncommitter %s %s\n\n%s\n",
+                       objects.author, raw_date, objects.committer, raw_date, commit->message);
+    if (!objects.write_object("commit", buffer, length, objects.tip)) {
+        return 0;
+    }
+    objects.has_tip = 1;
+    objects.commits++;
+    
+    if (objects.checkpoint > 0 && objects.commits % objects.checkpoint == 0) {
+        return objects_update_ref();
+    }
+    return 1;
+}
+
+/**
+ * Point the branch at the last commit, then sync the working tree and index
+ * if the branch is checked out
+ * @return: 1 on success, 0 on failure
+ */
+int objects_finish() {
+    const char* reset_argv[] = {"git", "reset", "-q", "--", DATA_FILE, DATA_DIR, NULL};
+    /* A resumed run holds only the files it touched; the others may still be
+     * where the run that died left them. The pattern matches both layouts */
+    const char* restore_argv[] = {"git", "checkout", "-q", "HEAD", "--", DATA_DIR "*", NULL};
+    char hex[41];
+    
+    workers_stop();
+    if (!pipeline_stop()) {
+        return 0;
+    }
+    if (objects.commits > 0) {
+        sha1_to_hex(objects.tip, hex);
+        /* A checkpoint may already have published the last commit */
+        if (strcmp(hex, objects.old_tip) != 0 && !objects_update_ref()) {
+            return 0;
+        }
+        if (objects.checked_out && !activity_write_back(&objects.activity)) {
+            return 0;
+        }
+        if (objects.checked_out && !run_git(resuming ? restore_argv : reset_argv)) {
+            fprintf(stderr, "Error: Failed to refresh the index\n");
+            return 0;
+        }
+    }
+    
+    activity_free(&objects.activity);
+    free(objects.root.entries);
+    free(objects.data_dir.entries);
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Plumbing backend: git hash-object and mktree per object, no index       */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * Same in-memory trees and tip as the objects backend, but every object is
+ * handed to git itself. Commits are serialized here and stored with
+ * `hash-object -t commit`, which gives the same bytes `commit-tree` would
+ * without depending on its environment.
+ */
+
+/**
+ * Turn a serialized tree into the text listing git mktree reads
+ * @param data: Tree payload, as built by write_tree()
+ * @param length: Payload size in bytes
+ * @param listing: Output, at least 3 * length bytes; not NUL terminated
+ * @return: Listing length in bytes
+ */
+size_t tree_listing(const void* data, size_t length, char* listing) {
+    const char* entry = data;
+    const char* end = entry + length;
+    size_t used = 0;
+    char hex[41];
+    
+    /* "<mode> <type> <hex>\t<name>" lines */
+    while (entry < end) {
+        unsigned int mode = (unsigned int)strtoul(entry, NULL, 8);
+        const char* name = strchr(entry, ' ') + 1;
+        const unsigned char* entry_sha = (const unsigned char*)name + strlen(name) + 1;
+        
+        sha1_to_hex(entry_sha, hex);
+        used += sprintf(listing + used, "%06o %s %s\t%s\n", mode,
+                        mode == MODE_TREE ? "tree" : "blob", hex, name);
+        entry = (const char*)entry_sha + 20;
+    }
+    return used;
+}
+
+/**
+ * Store one object through git plumbing
+ * @param type: "blob", "tree" or "commit"
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Output object id
+ * @return: 1 on success, 0 on failure
+ */
+int plumbing_write_object(const char* type, const void* data, size_t length, unsigned char* sha) {
+    const char* hash_object_argv[] = {"git", "hash-object", "-w", "-t", type, "--stdin", NULL};
+    const char* mktree_argv[] = {"git", "mktree", NULL};
+    char hex[MAX_REF_LENGTH];
+    
+    /* With a shared store, an object is only worth a git run if it is new */
+    if (shared_objects) {
+        hash_object(type, data, length, sha);
+        if (shared_object_present(sha)) {
+            return 1;
+        }
+    }
+    if (strcmp(type, "tree") == 0) {
+        /* mktree wants a text listing, not the raw tree */
+        char* listing = malloc(length * 3 + 64);
+        size_t used;
+        int ok;
+        
+        if (!listing) {
+            return 0;
+        }
+        used = tree_listing(data, length, listing);
+        ok = read_git_line(mktree_argv, listing, used, hex, sizeof(hex));
+        free(listing);
+        if (!ok || !hex_to_sha1(hex, sha)) {
+            fprintf(stderr, "Error: git mktree failed\n");
+            return 0;
+        }
+        return 1;
+    }
+    
+    if (!read_git_line(hash_object_argv, data, length, hex, sizeof(hex)) ||
+        !hex_to_sha1(hex, sha)) {
+        fprintf(stderr, "Error: git hash-object failed for a %s\n", type);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Store a new activity file version with git hash-object, whole
+ * @param blob: Activity file version
+ * @param sha: Output blob id
+ * @return: 1 on success, 0 on failure
+ */
+int plumbing_write_blob(const BlobVersion* blob, unsigned char* sha) {
+    return plumbing_write_object("blob", blob->content, blob->length, sha);
+}
+
+/**
+ * Resolve the target like the objects backend, then route objects to git
+ * @return: 1 on success, 0 on failure
+ */
+int plumbing_begin() {
+    return objects_begin(plumbing_write_object, plumbing_write_blob, 1);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Batch backend: long-lived git plumbing processes fed over pipes         */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * One git process per job for the whole run: hash-object --stdin-paths for
+ * blobs and for commits, mktree --batch for trees, update-ref --stdin for
+ * the branch and cat-file --batch to read existing files. Object ids are
+ * computed here, so a request never waits for its answer; up to
+ * BATCH_IN_FLIGHT answers per process stay outstanding (well inside a pipe
+ * buffer, so neither side can block the other) and are checked against the
+ * expected id as they arrive. hash-object reads paths, so blobs and commits
+ * go through numbered spool files that are removed once acknowledged.
+ * Trees may name blobs another process has not stored yet, hence
+ * mktree --missing; everything is drained before the branch moves.
+ */
+
+#define BATCH_IN_FLIGHT 64
+#define SPOOL_PATH_LENGTH (MAX_PATH_LENGTH + 16)
+
+/* A git process answering one line per request */
+typedef struct {
+    const char* name;
+    FILE* requests;
+    FILE* replies;
+    pid_t pid;
+    unsigned char expected[BATCH_IN_FLIGHT][20];
+    int spool[BATCH_IN_FLIGHT]; /* Spool file to remove once answered, or -1 */
+    int first;
+    int pending;
+} Coprocess;
+
+typedef struct {
+    Coprocess blobs;
+    Coprocess trees;
+    Coprocess commits;
+    Coprocess refs;
+    Coprocess reader;
+    char spool_dir[MAX_PATH_LENGTH];
+    int spool_next;
+} Batch;
+
+Batch batch;
+
+/**
+ * Start a git process with pipes to its stdin and from its stdout
+ * @param process: Coprocess to set up
+ * @param argv: Arguments, starting with "git" and ending with NULL
+ * @return: 1 on success, 0 on failure
+ */
+int coprocess_start(Coprocess* process, const char* const argv[]) {
+    int to_git[2], from_git[2];
+    
+    memset(process, 0, sizeof(*process));
+    process->name = argv[1];
+    if (!cloexec_pipe(to_git)) {
+        return 0;
+    }
+    if (!cloexec_pipe(from_git)) {
+        close(to_git[0]);
+        close(to_git[1]);
+        return 0;
+    }
+    process->pid = spawn_process(git_path(), argv, NULL, to_git[0], from_git[1], -1);
+    close(to_git[0]);
+    close(from_git[1]);
+    process->requests = fdopen(to_git[1], "w");
+    process->replies = fdopen(from_git[0], "r");
+    if (process->pid < 0 || !process->requests || !process->replies) {
+        fprintf(stderr, "Error: Failed to start git %s\n", process->name);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Build the path of a spool file
+ * @param number: Spool file number
+ * @param path: Output buffer of SPOOL_PATH_LENGTH bytes
+ */
+void spool_path(int number, char* path) {
+    snprintf(path, SPOOL_PATH_LENGTH, "%s/%d", batch.spool_dir, number);
+}
+
+/**
+ * Read and check the oldest outstanding answer
+ * @param process: Coprocess with at least one request pending
+ * @return: 1 if git stored the expected object, 0 otherwise
+ */
+int coprocess_collect(Coprocess* process) {
+    char line[MAX_REF_LENGTH];
+    char path[SPOOL_PATH_LENGTH];
+    unsigned char sha[20];
+    int slot = process->first;
+    
+    fflush(process->requests);
+    if (!fgets(line, sizeof(line), process->replies) || !hex_to_sha1(line, sha) ||
+        memcmp(sha, process->expected[slot], 20) != 0) {
+        fprintf(stderr, "Error: git %s did not store the expected object\n", process->name);
+        return 0;
+    }
+    if (process->spool[slot] >= 0) {
+        spool_path(process->spool[slot], path);
+        unlink(path);
+    }
+    process->first = (slot + 1) % BATCH_IN_FLIGHT;
+    process->pending--;
+    return 1;
+}
+
+/**
+ * Record the answer a request just written should produce
+ * @param process: Coprocess the request went to
+ * @param sha: Object id git must report
+ * @param spool: Spool file to remove once answered, or -1
+ * @return: 1 on success, 0 on failure
+ */
+int coprocess_expect(Coprocess* process, const unsigned char* sha, int spool) {
+    int slot;
+    
+    /* Bound what is in flight so git never blocks on a full reply pipe */
+    if (process->pending == BATCH_IN_FLIGHT && !coprocess_collect(process)) {
+        return 0;
+    }
+    slot = (process->first + process->pending) % BATCH_IN_FLIGHT;
+    memcpy(process->expected[slot], sha, 20);
+    process->spool[slot] = spool;
+    process->pending++;
+    return 1;
+}
+
+/**
+ * Wait until every request sent to a coprocess is answered
+ * @param process: Coprocess
+ * @return: 1 on success, 0 on failure
+ */
+int coprocess_drain(Coprocess* process) {
+    while (process->pending > 0) {
+        if (!coprocess_collect(process)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Drain a coprocess, close its stdin and wait for it to exit
+ * @param process: Coprocess, possibly never started
+ * @return: 1 if git exited cleanly, 0 otherwise
+ */
+int coprocess_stop(Coprocess* process) {
+    int ok = 1;
+    
+    if (process->requests) {
+        ok = coprocess_drain(process);
+        ok &= fclose(process->requests) == 0;
+    }
+    if (process->replies) {
+        fclose(process->replies);
+    }
+    if (process->pid > 0) {
+        ok &= wait_process(process->pid) == 0;
+    }
+    memset(process, 0, sizeof(*process));
+    return ok;
+}
+
+/**
+ * Queue one object whose id is already known with the matching coprocess
+ * @param type: "blob", "tree" or "commit"
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Object id the coprocess must answer with
+ * @return: 1 on success, 0 on failure
+ */
+int batch_store_object(const char* type, const void* data, size_t length, const unsigned char* sha) {
+    Coprocess* process = strcmp(type, "commit") == 0 ? &batch.commits : &batch.blobs;
+    char path[SPOOL_PATH_LENGTH];
+    FILE* file;
+    int failed;
+    
+    if (shared_object_present(sha)) {
+        return 1;
+    }
+    if (strcmp(type, "tree") == 0) {
+        char* listing = malloc(length * 3 + 64);
+        
+        if (!listing) {
+            return 0;
+        }
+        /* A blank line ends each tree in --batch mode */
+        fwrite(listing, 1, tree_listing(data, length, listing), batch.trees.requests);
+        fputc('\n', batch.trees.requests);
+        free(listing);
+        return coprocess_expect(&batch.trees, sha, -1);
+    }
+    
+    spool_path(batch.spool_next, path);
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot write spool file %s\n", path);
+        return 0;
+    }
+    failed = fwrite(data, 1, length, file) != length;
+    failed |= fclose(file) != 0;
+    if (failed) {
+        fprintf(stderr, "Error: Cannot write spool file %s\n", path);
+        unlink(path);
+        return 0;
+    }
+    fprintf(process->requests, "%s\n", path);
+    return coprocess_expect(process, sha, batch.spool_next++);
+}
+
+/**
+ * Queue one object with the matching coprocess
+ * @param type: "blob", "tree" or "commit"
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Output object id, computed here
+ * @return: 1 on success, 0 on failure
+ */
+int batch_write_object(const char* type, const void* data, size_t length, unsigned char* sha) {
+    hash_object(type, data, length, sha);
+    return batch_store_object(type, data, length, sha);
+}
+
+/**
+ * Queue a new activity file version as a blob, whole
+ * @param blob: Activity file version
+ * @param sha: Output blob id
+ * @return: 1 on success, 0 on failure
+ */
+int batch_write_blob(const BlobVersion* blob, unsigned char* sha) {
+    blob_id(blob, sha);
+    return batch_store_object("blob", blob->content, blob->length, sha);
+}
+
+/**
+ * Wait for every queued object, then move the branch in one transaction
+ * @param ref: Full ref name
+ * @param new_hex: New commit id
+ * @param old_hex: Expected current value; all zeros if it must not exist
+ * @return: 1 on success, 0 on failure
+ */
+int batch_update_ref(const char* ref, const char* new_hex, const char* old_hex) {
+    char line[MAX_REF_LENGTH];
+    
+    if (!coprocess_drain(&batch.blobs) || !coprocess_drain(&batch.trees) ||
+        !coprocess_drain(&batch.commits)) {
+        return 0;
+    }
+    fprintf(batch.refs.requests, "start\nupdate %s %s %s\ncommit\n", ref, new_hex, old_hex);
+    fflush(batch.refs.requests);
+    /* "start: ok" then "commit: ok"; git exits instead if the update fails */
+    return fgets(line, sizeof(line), batch.refs.replies) && strcmp(line, "start: ok\n") == 0 &&
+           fgets(line, sizeof(line), batch.refs.replies) && strcmp(line, "commit: ok\n") == 0;
+}
+
+/**
+ * Load an activity file from the target commit through cat-file --batch
+ * @param shard: Shard whose path is set; content is filled in
+ * @param source: Commit to read the file from, or "" for the working tree
+ * @return: 1 on success, 0 on failure
+ */
+int batch_load_shard(ActivityShard* shard, const char* source) {
+    char header[MAX_PATH_LENGTH + 64];
+    char type[16];
+    size_t size;
+    
+    if (!source[0]) {
+        return load_activity_shard(shard, source);
+    }
+    shard->content = NULL;
+    shard->length = 0;
+    shard->capacity = 0;
+    
+    fprintf(batch.reader.requests, "%s:%s\n", source, shard->path);
+    fflush(batch.reader.requests);
+    /* "<id> blob <size>" and the content, or "<name> missing" */
+    if (!fgets(header, sizeof(header), batch.reader.replies)) {
+        return 0;
+    }
+    if (sscanf(header, "%*s %15s %zu", type, &size) != 2) {
+        return 1; /* Not in that commit yet */
+    }
+    shard->capacity = size + MAX_ENTRY_LENGTH;
+    shard->content = malloc(shard->capacity);
+    if (!shard->content || fread(shard->content, 1, size, batch.reader.replies) != size ||
+        fgetc(batch.reader.replies) != '\n') {
+        return 0;
+    }
+    shard->length = size;
+    return strcmp(type, "blob") == 0;
+}
+
+/**
+ * Resolve the target like the objects backend, then start the coprocesses
+ * @return: 1 on success, 0 on failure
+ */
+int batch_begin() {
+    const char* blobs_argv[] = {"git", "hash-object", "-w", "--stdin-paths", NULL};
+    const char* commits_argv[] = {"git", "hash-object", "-w", "-t", "commit", "--stdin-paths",
+                                  NULL};
+    const char* trees_argv[] = {"git", "mktree", "--missing", "--batch", NULL};
+    const char* refs_argv[] = {"git", "update-ref", "-m", "cyclops", "--stdin", NULL};
+    const char* reader_argv[] = {"git", "cat-file", "--batch", NULL};
+    char spool_dir[MAX_PATH_LENGTH];
+    char* absolute;
+    
+    /* Absolute, since git resolves --stdin-paths against its own prefix */
+    snprintf(spool_dir, sizeof(spool_dir), "%s/cyclops-spool-XXXXXX", git_dir);
+    if (!mkdtemp(spool_dir) || !(absolute = realpath(spool_dir, NULL))) {
+        fprintf(stderr, "Error: Cannot create a spool directory in %s\n", git_dir);
+        return 0;
+    }
+    snprintf(batch.spool_dir, sizeof(batch.spool_dir), "%s", absolute);
+    free(absolute);
+    if (!coprocess_start(&batch.blobs, blobs_argv) ||
+        !coprocess_start(&batch.commits, commits_argv) ||
+        !coprocess_start(&batch.trees, trees_argv) ||
+        !coprocess_start(&batch.refs, refs_argv) ||
+        !coprocess_start(&batch.reader, reader_argv)) {
+        return 0;
+    }
+    
+    objects.activity.load = batch_load_shard;
+    if (!objects_begin(batch_write_object, batch_write_blob, 0)) {
+        return 0;
+    }
+    objects.update_ref = batch_update_ref;
+    return 1;
+}
+
+/**
+ * Publish the branch, stop the coprocesses and remove the spool
+ * @return: 1 on success, 0 on failure
+ */
+int batch_finish() {
+    int ok = objects_finish();
+    char path[SPOOL_PATH_LENGTH];
+    
+    ok &= coprocess_stop(&batch.blobs);
+    ok &= coprocess_stop(&batch.trees);
+    ok &= coprocess_stop(&batch.commits);
+    ok &= coprocess_stop(&batch.refs);
+    ok &= coprocess_stop(&batch.reader);
+    
+    /* Normally empty by now; leftovers mean git never confirmed them */
+    for (int i = 0; i < batch.spool_next; i++) {
+        spool_path(i, path);
+        unlink(path);
+    }
+    rmdir(batch.spool_dir);
+    return ok;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Pack backend: one .pack/.idx pair with append-only OFS_DELTA chains     */
+/* ---------------------------------------------------------------------- */
+
+#define PACK_OBJ_COMMIT 1
+#define PACK_OBJ_TREE 2
+#define PACK_OBJ_BLOB 3
+#define PACK_OBJ_OFS_DELTA 6
+#define PACK_MAX_DELTA_DEPTH 50 /* Same as pack.depth, keeps reads cheap */
+#define PACK_MAX_COPY 0x10000   /* Largest copy op git itself emits */
+
+/* Where an object landed in the pack, for the .idx */
+typedef struct {
+    unsigned char sha[20];
+    uint32_t crc;
+    uint64_t offset;
+} PackEntry;
+
+/*
+ * Every version of an activity file is the previous version plus a tail,
+ * so each blob after the first is stored as "copy the base, insert the
+ * tail" against the previous version, up to PACK_MAX_DELTA_DEPTH deep.
+ */
+typedef struct {
+    FILE* file;
+    char temp_path[OBJECT_PATH_LENGTH];
+    long file_base;  /* Bytes in front of the pack, e.g. a bundle header */
+    uint64_t offset; /* Pack-relative, which is what OFS_DELTA counts in */
+    PackEntry* entries;
+    uint32_t count;
+    uint32_t allocated;
+    int base_file;
+    uint64_t base_offset;
+    int base_depth;
+    unsigned char* scratch;
+    size_t scratch_size;
+} PackWriter;
+
+PackWriter pack;
+
+/**
+ * Make sure the scratch buffer holds at least a given number of bytes
+ * @param size: Bytes needed
+ * @return: 1 on success, 0 on failure
+ */
+int pack_reserve_scratch(size_t size) {
+    if (size > pack.scratch_size) {
+        unsigned char* scratch = realloc(pack.scratch, size);
+        if (!scratch) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 0;
+        }
+        pack.scratch = scratch;
+        pack.scratch_size = size;
+    }
+    return 1;
+}
+
+/**
+ * Append one entry (header, optional delta base offset, deflated body)
+ * @param type: PACK_OBJ_* type of the entry
+ * @param sha: Id of the object the entry reconstructs
+ * @param body: Object payload or delta
+ * @param length: Size of body in bytes
+ * @param base_offset: Pack offset of the delta base, for OFS_DELTA only
+ * @return: 1 on success, 0 on failure
+ */
+int pack_write_entry(int type, const unsigned char* sha, const void* body, size_t length,
+                     uint64_t base_offset) {
+    unsigned char header[32];
+    int header_length = 0;
+    size_t size = length;
+    uLongf compressed_length = compressBound(length);
+    PackEntry* entry;
+    uint32_t crc;
+    
+    if (pack.count == pack.allocated) {
+        uint32_t allocated = pack.allocated ? pack.allocated * 2 : 1024;
+        PackEntry* entries = realloc(pack.entries, allocated * sizeof(*entries));
+        if (!entries) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 0;
+        }
+        pack.entries = entries;
+        pack.allocated = allocated;
+    }
+    
+    /* Type and size: 3 type bits, then the size in little-endian 7-bit groups */
+    header[header_length++] = (unsigned char)((type << 4) | (size & 15));
+    size >>= 4;
+    while (size) {
+        header[header_length - 1] |= 0x80;
+        header[header_length++] = size & 0x7f;
+        size >>= 7;
+    }
+    if (type == PACK_OBJ_OFS_DELTA) {
+        /* Distance back to the base, big-endian with git's +1 bias per group */
+        unsigned char distance[16];
+        int position = sizeof(distance) - 1;
+        uint64_t value = pack.offset - base_offset;
+        
+        distance[position] = value & 0x7f;
+        while (value >>= 7) {
+            distance[--position] = 0x80 | (--value & 0x7f);
+        }
+        memcpy(header + header_length, distance + position, sizeof(distance) - position);
+        header_length += sizeof(distance) - position;
+    }
+    
+    if (!pack_reserve_scratch(compressed_length) ||
+        compress2(pack.scratch, &compressed_length, body, length, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "Error: Failed to compress pack entry\n");
+        return 0;
+    }
+    crc = crc32(0, header, header_length);
+    crc = crc32(crc, pack.scratch, compressed_length);
+    
+    if (fwrite(header, 1, header_length, pack.file) != (size_t)header_length ||
+        fwrite(pack.scratch, 1, compressed_length, pack.file) != compressed_length) {
+        fprintf(stderr, "Error: Cannot write pack file\n");
+        return 0;
+    }
+    
+    entry = &pack.entries[pack.count++];
+    memcpy(entry->sha, sha, 20);
+    entry->crc = crc;
+    entry->offset = pack.offset;
+    pack.offset += header_length + compressed_length;
+    return 1;
+}
+
+/**
+ * Store a whole tree or commit object in the pack
+ * @param type: "tree" or "commit"
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Output object id
+ * @return: 1 on success, 0 on failure
+ */
+int pack_write_object(const char* type, const void* data, size_t length, unsigned char* sha) {
+    int pack_type = strcmp(type, "commit") == 0 ? PACK_OBJ_COMMIT :
+                    strcmp(type, "tree") == 0 ? PACK_OBJ_TREE : PACK_OBJ_BLOB;
+    
+    hash_object(type, data, length, sha);
+    if (shared_object_present(sha)) {
+        return 1;
+    }
+    return pack_write_entry(pack_type, sha, data, length, 0);
+}
+
+/**
+ * Append a little-endian base-128 size to a delta
+ * @param out: Where to write, at least 10 bytes
+ * @param size: Size to encode
+ * @return: Number of bytes written
+ */
+int delta_put_size(unsigned char* out, size_t size) {
+    int length = 0;
+    
+    do {
+        out[length] = size & 0x7f;
+        size >>= 7;
+        if (size) {
+            out[length] |= 0x80;
+        }
+        length++;
+    } while (size);
+    return length;
+}
+
+/**
+ * Store the newest version of an activity file, as a delta on the previous
+ * version when that one is in this pack and the chain is not too deep
+ * @param blob: Activity file version
+ * @param sha: Output blob id
+ * @return: 1 on success, 0 on failure
+ */
+int pack_write_blob(const BlobVersion* blob, unsigned char* sha) {
+    size_t previous_length = blob->previous_length;
+    size_t tail = blob->length - previous_length;
+    size_t copy_ops = previous_length / PACK_MAX_COPY + 1;
+    size_t insert_ops = tail / 127 + 1;
+    unsigned char* delta;
+    size_t length = 0;
+    uint64_t offset = pack.offset;
+    int ok;
+    
+    blob_id(blob, sha);
+    if (shared_object_present(sha)) {
+        pack.base_file = -1; /* The next version has no base in this pack */
+        return 1;
+    }
+    
+    if (pack.base_file != blob->file || pack.base_depth >= PACK_MAX_DELTA_DEPTH) {
+        if (!pack_write_entry(PACK_OBJ_BLOB, sha, blob->content, blob->length, 0)) {
+            return 0;
+        }
+        pack.base_file = blob->file;
+        pack.base_offset = offset;
+        pack.base_depth = 0;
+        return 1;
+    }
+    
+    delta = malloc(20 + copy_ops * 8 + insert_ops + tail);
+    if (!delta) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+    length += delta_put_size(delta + length, previous_length);
+    length += delta_put_size(delta + length, blob->length);
+    
+    /* Copy the previous version in PACK_MAX_COPY chunks... */
+    for (size_t copied = 0; copied < previous_length; copied += PACK_MAX_COPY) {
+        size_t size = previous_length - copied < PACK_MAX_COPY ? previous_length - copied
+                                                                : PACK_MAX_COPY;
+        unsigned char* op = &delta[length++];
+        
+        *op = 0x80;
+        for (int i = 0; i < 4; i++) {
+            if ((copied >> (i * 8)) & 0xff) {
+                delta[length++] = (copied >> (i * 8)) & 0xff;
+                *op |= 1 << i;
+            }
+        }
+        /* A size of 0x10000 is encoded by leaving all size bytes out */
+        if (size != PACK_MAX_COPY) {
+            for (int i = 0; i < 3; i++) {
+                if ((size >> (i * 8)) & 0xff) {
+                    delta[length++] = (size >> (i * 8)) & 0xff;
+                    *op |= 0x10 << i;
+                }
+            }
+        }
+    }
+    /* ...then insert the new tail, at most 127 bytes per op */
+    for (size_t inserted = 0; inserted < tail; inserted += 127) {
+        size_t size = tail - inserted < 127 ? tail - inserted : 127;
+        delta[length++] = (unsigned char)size;
+        memcpy(delta + length, blob->content + previous_length + inserted, size);
+        length += size;
+    }
+    
+    ok = pack_write_entry(PACK_OBJ_OFS_DELTA, sha, delta, length, pack.base_offset);
+    free(delta);
+    if (ok) {
+        pack.base_offset = offset;
+        pack.base_depth++;
+    }
+    return ok;
+}
+
+/**
+ * Create the file named by the mkstemp template in pack.temp_path and
+ * start it with a prefix and a pack header with a placeholder object count
+ * @param prefix: Bytes written in front of the pack
+ * @param prefix_length: Size of the prefix
+ * @return: 1 on success, 0 on failure
+ */
+int pack_open(const char* prefix, size_t prefix_length) {
+    static const unsigned char header[12] = {'P', 'A', 'C', 'K', 0, 0, 0, 2, 0, 0, 0, 0};
+    int fd = mkstemp(pack.temp_path);
+    
+    if (fd < 0 || !(pack.file = fdopen(fd, "w+b"))) {
+        fprintf(stderr, "Error: Cannot create %s\n", pack.temp_path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    fwrite(prefix, 1, prefix_length, pack.file);
+    fwrite(header, 1, sizeof(header), pack.file);
+    pack.file_base = (long)prefix_length;
+    pack.offset = sizeof(header);
+    pack.base_file = -1;
+    return 1;
+}
+
+/**
+ * Start the pack: resolve the target like the objects backend, then open
+ * a temporary pack file
+ * @return: 1 on success, 0 on failure
+ */
+int pack_begin() {
+    if (checkpoint_interval > 0) {
+        fprintf(stderr, "Error: The pack backend can only update the branch at the end\n");
+        return 0;
+    }
+    snprintf(pack.temp_path, sizeof(pack.temp_path), "%s/pack", object_dir);
+    mkdir(pack.temp_path, 0777);
+    snprintf(pack.temp_path, sizeof(pack.temp_path), "%s/pack/tmp_pack_XXXXXX", object_dir);
+    return pack_open("", 0) && objects_begin(pack_write_object, pack_write_blob, 0);
+}
+
+/**
+ * Order pack entries by object id, for the .idx
+ * @return: <0, 0 or >0 like memcmp
+ */
+int pack_entry_compare(const void* a, const void* b) {
+    return memcmp(((const PackEntry*)a)->sha, ((const PackEntry*)b)->sha, 20);
+}
+
+/**
+ * Write a big-endian 32-bit value and feed it to a checksum
+ * @param file: Output file
+ * @param sha: Checksum of everything written so far
+ * @param value: Value to write
+ */
+void write_be32(FILE* file, Sha1* sha, uint32_t value) {
+    unsigned char bytes[4] = {value >> 24, value >> 16, value >> 8, value};
+    fwrite(bytes, 1, 4, file);
+    sha1_update(sha, bytes, 4);
+}
+
+/**
+ * Write the version 2 .idx for the finished pack
+ * @param path: Output path
+ * @param pack_sha: Trailing checksum of the pack
+ * @return: 1 on success, 0 on failure
+ */
+int pack_write_index(const char* path, const unsigned char* pack_sha) {
+    static const unsigned char magic[8] = {0xff, 't', 'O', 'c', 0, 0, 0, 2};
+    FILE* file = fopen(path, "wb");
+    unsigned char checksum[20];
+    uint32_t fanout = 0;
+    uint32_t large_offsets = 0;
+    Sha1 ctx;
+    int failed;
+    
+    if (!file) {
+        return 0;
+    }
+    sha1_init(&ctx);
+    fwrite(magic, 1, sizeof(magic), file);
+    sha1_update(&ctx, magic, sizeof(magic));
+    
+    qsort(pack.entries, pack.count, sizeof(*pack.entries), pack_entry_compare);
+    for (int byte = 0; byte < 256; byte++) {
+        while (fanout < pack.count && pack.entries[fanout].sha[0] == byte) {
+            fanout++;
+        }
+        write_be32(file, &ctx, fanout);
+    }
+    for (uint32_t i = 0; i < pack.count; i++) {
+        fwrite(pack.entries[i].sha, 1, 20, file);
+        sha1_update(&ctx, pack.entries[i].sha, 20);
+    }
+    for (uint32_t i = 0; i < pack.count; i++) {
+        write_be32(file, &ctx, pack.entries[i].crc);
+    }
+    /* Offsets past 2 GiB go to a trailing 64-bit table */
+    for (uint32_t i = 0; i < pack.count; i++) {
+        if (pack.entries[i].offset < 0x80000000u) {
+            write_be32(file, &ctx, (uint32_t)pack.entries[i].offset);
+        } else {
+            write_be32(file, &ctx, 0x80000000u | large_offsets++);
+        }
+    }
+    for (uint32_t i = 0; i < pack.count; i++) {
+        if (pack.entries[i].offset >= 0x80000000u) {
+            write_be32(file, &ctx, (uint32_t)(pack.entries[i].offset >> 32));
+            write_be32(file, &ctx, (uint32_t)pack.entries[i].offset);
+        }
+    }
+    fwrite(pack_sha, 1, 20, file);
+    sha1_update(&ctx, pack_sha, 20);
+    sha1_final(&ctx, checksum);
+    fwrite(checksum, 1, 20, file);
+    
+    failed = ferror(file);
+    failed |= fclose(file) != 0;
+    return !failed;
+}
+
+/**
+ * Patch the object count and append the checksum; the file stays open
+ * @param checksum: Output pack checksum, which also names the pack
+ * @return: 1 on success, 0 on failure
+ */
+int pack_seal(unsigned char* checksum) {
+    unsigned char count[4];
+    unsigned char buffer[65536];
+    size_t length;
+    Sha1 ctx;
+    
+    /* The count was unknown up front; the checksum covers the fixed header */
+    count[0] = pack.count >> 24;
+    count[1] = pack.count >> 16;
+    count[2] = pack.count >> 8;
+    count[3] = pack.count;
+    fseek(pack.file, pack.file_base + 8, SEEK_SET);
+    fwrite(count, 1, 4, pack.file);
+    fflush(pack.file);
+    fseek(pack.file, pack.file_base, SEEK_SET);
+    sha1_init(&ctx);
+    while ((length = fread(buffer, 1, sizeof(buffer), pack.file)) > 0) {
+        sha1_update(&ctx, buffer, length);
+    }
+    sha1_final(&ctx, checksum);
+    fseek(pack.file, 0, SEEK_END);
+    fwrite(checksum, 1, 20, pack.file);
+    return !ferror(pack.file);
+}
+
+/**
+ * Release the pack writer's buffers
+ */
+void pack_free() {
+    free(pack.entries);
+    free(pack.scratch);
+    pack.entries = NULL;
+    pack.scratch = NULL;
+    pack.scratch_size = 0;
+}
+
+/**
+ * Seal the pack, write its .idx and move both into place, then update the
+ * branch like the objects backend
+ * @return: 1 on success, 0 on failure
+ */
+int pack_finish() {
+    unsigned char checksum[20];
+    char hex[41];
+    char pack_path[OBJECT_PATH_LENGTH];
+    char index_path[OBJECT_PATH_LENGTH];
+    int renamed = 0;
+    int failed;
+    
+    /* Objects still queued for the pack go in before it is sealed */
+    workers_stop();
+    if (!pipeline_stop()) {
+        fclose(pack.file);
+        unlink(pack.temp_path);
+        pack_free();
+        return 0;
+    }
+    if (pack.count == 0) {
+        fclose(pack.file);
+        unlink(pack.temp_path);
+        pack_free();
+        return objects_finish();
+    }
+    
+    failed = !pack_seal(checksum);
+    failed |= fclose(pack.file) != 0;
+    
+    sha1_to_hex(checksum, hex);
+    snprintf(pack_path, sizeof(pack_path), "%s/pack/pack-%s.pack", object_dir, hex);
+    snprintf(index_path, sizeof(index_path), "%s/pack/pack-%s.idx", object_dir, hex);
+    
+    /* The .idx is what makes a pack visible, so it goes in last */
+    if (!failed) {
+        renamed = rename(pack.temp_path, pack_path) == 0;
+        failed = !renamed || !pack_write_index(index_path, checksum);
+    }
+    pack_free();
+    if (failed) {
+        fprintf(stderr, "Error: Cannot write pack %s\n", hex);
+        /* Leave neither a pack without its .idx nor a partial .idx */
+        unlink(renamed ? pack_path : pack.temp_path);
+        if (renamed) {
+            unlink(index_path);
+        }
+        return 0;
+    }
+    return objects_finish();
+}
+
+/* ---------------------------------------------------------------------- */
+/* Memory backend: every object hashed into a table, nothing leaves memory  */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * The same trees, commits and ids as the git backends, without git: a run
+ * costs only the plan, the content and the hashing, which makes it the
+ * baseline the other backends are measured against, and a stand-in where
+ * a repository would only get in the way. Trees and commits are copied;
+ * a blob is only a length, since every version of an activity file is a
+ * prefix of the file as it is now.
+ */
+typedef struct {
+    unsigned char sha[20];
+    const char* type;  /* "blob", "tree" or "commit"; NULL for a free slot */
+    int file;          /* Activity file a blob is a prefix of, -1 otherwise */
+    size_t length;
+    char* data;        /* Copy of a tree or commit, NULL for a blob */
+} MemoryObject;
+
+typedef struct {
+    MemoryObject* slots; /* Open addressing, a power of two in size */
+    size_t capacity;
+    size_t count;
+    size_t duplicates;
+    size_t blob_bytes;
+    size_t copied_bytes;
+} MemoryStore;
+
+MemoryStore memory;
+
+/**
+ * Find an object, or the free slot it would go in
+ * @param sha: Object id
+ * @return: Slot, with type NULL if the object is not stored
+ */
+MemoryObject* memory_slot(const unsigned char* sha) {
+    size_t mask = memory.capacity - 1;
+    size_t index;
+    
+    /* Object ids are uniformly distributed, so their first bytes hash well */
+    memcpy(&index, sha, sizeof(index));
+    for (index &= mask; memory.slots[index].type; index = (index + 1) & mask) {
+        if (memcmp(memory.slots[index].sha, sha, 20) == 0) {
+            break;
+        }
+    }
+    return &memory.slots[index];
+}
+
+/**
+ * Look an object up
+ * @param sha: Object id
+ * @return: The object, or NULL if it is not stored
+ */
+const MemoryObject* memory_find(const unsigned char* sha) {
+    const MemoryObject* object = memory.capacity ? memory_slot(sha) : NULL;
+    return object && object->type ? object : NULL;
+}
+
+/**
+ * Claim the slot for a new object, growing the table to stay under 3/4 full
+ * @param sha: Object id
+ * @return: The slot (type already set if the object was stored before), or
+ *          NULL if out of memory
+ */
+MemoryObject* memory_claim(const unsigned char* sha) {
+    MemoryObject* slot;
+    
+    if ((memory.count + 1) * 4 > memory.capacity * 3) {
+        MemoryStore old = memory;
+        
+        memory.capacity = old.capacity ? old.capacity * 2 : 4096;
+        memory.slots = calloc(memory.capacity, sizeof(*memory.slots));
+        if (!memory.slots) {
+            memory = old;
+            fprintf(stderr, "Error: Out of memory\n");
+            return NULL;
+        }
+        for (size_t i = 0; i < old.capacity; i++) {
+            if (old.slots[i].type) {
+                *memory_slot(old.slots[i].sha) = old.slots[i];
+            }
+        }
+        free(old.slots);
+    }
+    slot = memory_slot(sha);
+    if (slot->type) {
+        memory.duplicates++;
+    }
+    return slot;
+}
+
+/**
+ * Hash and keep a copy of a tree or commit
+ * @param type: "tree" or "commit"
+ * @param data: Object payload
+ * @param length: Payload size in bytes
+ * @param sha: Output object id
+ * @return: 1 on success, 0 on failure
+ */
+int memory_write_object(const char* type, const void* data, size_t length, unsigned char* sha) {
+    MemoryObject* slot;
+    
+    hash_object(type, data, length, sha);
+    if (!(slot = memory_claim(sha))) {
+        return 0;
+    }
+    if (slot->type) {
+        return 1;
+    }
+    if (!(slot->data = malloc(length))) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+    memcpy(slot->data, data, length);
+    memcpy(slot->sha, sha, 20);
+    slot->type = strcmp(type, "commit") == 0 ? "commit" : "tree";
+    slot->file = -1;
+    slot->length = length;
+    memory.count++;
+    memory.copied_bytes += length;
+    return 1;
+}
+
+/**
+ * Hash an activity file version and remember which prefix it is
+ * @param blob: Activity file version
+ * @param sha: Output blob id
+ * @return: 1 on success, 0 on failure
+ */
+int memory_write_blob(const BlobVersion* blob, unsigned char* sha) {
+    MemoryObject* slot;
+    
+    blob_id(blob, sha);
+    if (!(slot = memory_claim(sha))) {
+        return 0;
+    }
+    if (slot->type) {
+        return 1;
+    }
+    memcpy(slot->sha, sha, 20);
+    slot->type = "blob";
+    slot->file = blob->file;
+    slot->length = blob->length;
+    slot->data = NULL;
+    memory.count++;
+    memory.blob_bytes += blob->length;
+    return 1;
+}
+
+/**
+ * Moving the branch is only remembering the tip
+ * @param ref: Full ref name
+ * @param new_hex: New commit id
+ * @param old_hex: Previous commit id
+ * @return: 1
+ */
+int memory_update_ref(const char* ref, const char* new_hex, const char* old_hex) {
+    return 1;
+}
+
+/**
+ * Start a new history in memory, signed like a new repository would be
+ * @return: 1 on success, 0 on failure
+ */
+int memory_begin() {
+    snprintf(objects.ref, sizeof(objects.ref), "refs/heads/%s",
+             target_branch ? target_branch : "main");
+    snprintf(objects.author, sizeof(objects.author), "Cyclops <cyclops@github.com>");
+    snprintf(objects.committer, sizeof(objects.committer), "Cyclops <cyclops@github.com>");
+    objects.standalone = 1;
+    if (!objects_begin(memory_write_object, memory_write_blob, 0)) {
+        return 0;
+    }
+    objects.update_ref = memory_update_ref;
+    return 1;
+}
+
+/**
+ * Finish like the objects backend, then report what the store holds and
+ * release it
+ * @return: 1 on success, 0 on failure
+ */
+int memory_finish() {
+    char hex[41];
+    
+    if (!objects_finish()) {
+        return 0;
+    }
+    sha1_to_hex(objects.tip, hex);
+    printf("Memory store: %zu objects (%zu already stored), %.1f KiB of trees and commits "
+           "copied, %.1f KiB of blobs referenced\n",
+           memory.count, memory.duplicates, memory.copied_bytes / 1024.0,
+           memory.blob_bytes / 1024.0);
+    if (objects.commits > 0) {
+        printf("%s would point at %s\n", objects.ref, hex);
+    }
+    for (size_t i = 0; i < memory.capacity; i++) {
+        free(memory.slots[i].data);
+    }
+    free(memory.slots);
+    memset(&memory, 0, sizeof(memory));
+    return 1;
+}
+
+Backend backends[] = {
+    {"fast-import", "stream all commits into one git fast-import process",
+     init_git_repo, fast_import_begin, fast_import_add_commit, fast_import_finish},
+    {"objects", "write loose objects in-process, update the branch once",
+     init_git_repo, loose_begin, objects_add_commit, objects_finish},
+    {"pack", "write one pack with append-only deltas in-process, update the branch once",
+     init_git_repo, pack_begin, objects_add_commit, pack_finish},
+    {"plumbing", "run git hash-object and mktree per object, no index, update the branch once",
+     init_git_repo, plumbing_begin, objects_add_commit, objects_finish},
+    {"batch", "pipeline objects to long-lived git hash-object/mktree/update-ref processes",
+     init_git_repo, batch_begin, objects_add_commit, batch_finish},
+    {"porcelain", "run git add and git commit for every commit (slow fallback)",
+     init_git_repo, NULL, porcelain_add_commit, NULL},
+    {"memory", "hash every object into an in-memory store, no git and no I/O (baseline)",
+     NULL, memory_begin, objects_add_commit, memory_finish},
+};
+
+/**
+ * Look up a backend by name
+ * @param name: Backend name given on the command line
+ * @return: The backend, or NULL if there is no such backend
+ */
+const Backend* find_backend(const char* name) {
+    int count = sizeof(backends) / sizeof(backends[0]);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(backends[i].name, name) == 0) {
+            return &backends[i];
+        }
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Bundle: the pack behind a v2 bundle header, no repository needed       */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * A bundle is "# v2 git bundle", one "<id> <ref>" line per ref, a blank
+ * line and a pack; git clone and git fetch read it like a remote. The tip
+ * is only known once the pack is done, so the header first goes out with
+ * zeros in its place and is rewritten over them at the end: an object id
+ * is always 40 hex digits, so nothing after it moves.
+ */
+
+/**
+ * Format the bundle header: the branch, and HEAD so a clone checks it out
+ * @param header: Output buffer
+ * @param max_length: Size of the output buffer
+ * @param hex: Tip commit id
+ * @return: Header length in bytes
+ */
+int bundle_header(char* header, int max_length, const char* hex) {
+    return snprintf(header, max_length, "# v2 git bundle\n%s %s\n%s HEAD\n\n",
+                    hex, objects.ref, hex);
+}
+
+/**
+ * Start a new history in a temporary file next to the bundle, behind a
+ * placeholder header
+ * @return: 1 on success, 0 on failure
+ */
+int bundle_begin() {
+    const char* check_argv[] = {"git", "check-ref-format", objects.ref, NULL};
+    char header[MAX_REF_LENGTH + 128];
+    GitCall call;
+    
+    snprintf(objects.ref, sizeof(objects.ref), "refs/heads/%s",
+             target_branch ? target_branch : "main");
+    objects.standalone = 1;
+    memset(&call, 0, sizeof(call));
+    if (!git_call(check_argv, &call)) {
+        fprintf(stderr, "Error: '%s' is not a valid branch name\n", target_branch);
+        return 0;
+    }
+    if (snprintf(pack.temp_path, sizeof(pack.temp_path), "%s.XXXXXX", bundle_path) >=
+        (int)sizeof(pack.temp_path)) {
+        fprintf(stderr, "Error: Bundle path too long: %s\n", bundle_path);
+        return 0;
+    }
+    return pack_open(header, bundle_header(header, sizeof(header),
+                                           "0000000000000000000000000000000000000000")) &&
+           objects_begin(pack_write_object, pack_write_blob, 0);
+}
+
+/**
+ * Seal the pack, put the tip into the header and move the bundle into place
+ * @return: 1 on success, 0 on failure
+ */
+int bundle_finish() {
+    unsigned char checksum[20];
+    char header[MAX_REF_LENGTH + 128];
+    char hex[41];
+    mode_t mask;
+    int failed;
+    
+    workers_stop();
+    if (!pipeline_stop()) {
+        fclose(pack.file);
+        unlink(pack.temp_path);
+        pack_free();
+        return 0;
+    }
+    if (pack.count == 0) {
+        /* git rejects a bundle without refs, so there is nothing to write */
+        fclose(pack.file);
+        unlink(pack.temp_path);
+        pack_free();
+        printf("No commits, so %s was not written\n", bundle_path);
+        return objects_finish();
+    }
+    
+    failed = !pack_seal(checksum);
+    sha1_to_hex(objects.tip, hex);
+    fseek(pack.file, 0, SEEK_SET);
+    fwrite(header, 1, bundle_header(header, sizeof(header), hex), pack.file);
+    failed |= ferror(pack.file);
+    /* mkstemp made it private; give it the mode any new file would get */
+    mask = umask(0);
+    umask(mask);
+    failed |= fchmod(fileno(pack.file), 0666 & ~mask) != 0;
+    failed |= fclose(pack.file) != 0;
+    pack_free();
+    if (failed || rename(pack.temp_path, bundle_path) != 0) {
+        fprintf(stderr, "Error: Cannot write bundle %s\n", bundle_path);
+        unlink(pack.temp_path);
+        return 0;
+    }
+    
+    /* The header is the bundle's only ref, so there is nothing left to move */
+    memcpy(objects.old_tip, hex, sizeof(hex));
+    return objects_finish();
+}
+
+Backend bundle_backend = {"bundle", "write a v2 bundle file, no repository needed",
+                          NULL, bundle_begin, objects_add_commit, bundle_finish};
+
+/* ---------------------------------------------------------------------- */
+/* Bulk mode: repository-local overrides that only last for the run        */
+/* ---------------------------------------------------------------------- */
+
+/* One config setting replaced for the duration of the run */
+typedef struct {
+    const char* key;
+    const char* value;
+    char saved[MAX_COMMAND_LENGTH];
+    int was_set;
+} ConfigOverride;
+
+ConfigOverride bulk_overrides[] = {
+    {"gc.auto", "0"},                  /* No `gc --auto` after each commit */
+    {"maintenance.auto", "false"},     /* ...nor its newer maintenance form */
+    {"core.hooksPath", "/dev/null"},   /* A hooks directory with no hooks */
+    {"core.fsyncMethod", "batch"},     /* One flush per command, not per object */
+};
+
+int bulk_applied = 0;
+
+/* Set by SIGINT/SIGTERM; the main loop stops at the next commit boundary */
+volatile sig_atomic_t interrupted = 0;
+
+/**
+ * Record an interrupt and let a second one terminate immediately
+ * @param signal_number: Signal received
+ */
+void handle_interrupt(int signal_number) {
+    interrupted = 1;
+    signal(signal_number, SIG_DFL);
+}
+
+/**
+ * Put back every setting bulk_begin() replaced; registered with atexit()
+ */
+void bulk_restore(void) {
+    int count = sizeof(bulk_overrides) / sizeof(bulk_overrides[0]);
+    
+    if (!bulk_applied) {
+        return;
+    }
+    bulk_applied = 0;
+    
+    for (int i = 0; i < count; i++) {
+        const char* set_argv[] = {"git", "config", "--local", bulk_overrides[i].key,
+                                  bulk_overrides[i].saved, NULL};
+        const char* unset_argv[] = {"git", "config", "--local", "--unset",
+                                    bulk_overrides[i].key, NULL};
+        
+        if (!run_git(bulk_overrides[i].was_set ? set_argv : unset_argv)) {
+            fprintf(stderr, "Warning: Could not restore %s\n", bulk_overrides[i].key);
+        }
+    }
+}
+
+/**
+ * Save the current settings and apply the bulk overrides
+ * @return: 1 on success, 0 on failure
+ */
+int bulk_begin() {
+    int count = sizeof(bulk_overrides) / sizeof(bulk_overrides[0]);
+    
+    for (int i = 0; i < count; i++) {
+        const char* argv[] = {"git", "config", "--local", "--get", bulk_overrides[i].key, NULL};
+        GitCall call;
+        
+        /* Exit status 1 means unset; an empty value is still a setting to keep */
+        memset(&call, 0, sizeof(call));
+        call.output = bulk_overrides[i].saved;
+        call.output_size = sizeof(bulk_overrides[i].saved);
+        git_call(argv, &call);
+        if (call.status != 0 && call.status != 1) {
+            fputs(call.error, stderr);
+            fprintf(stderr, "Error: Could not read %s\n", bulk_overrides[i].key);
+            return 0;
+        }
+        bulk_overrides[i].saved[strcspn(bulk_overrides[i].saved, "\n")] = '\0';
+        bulk_overrides[i].was_set = call.status == 0;
+    }
+    
+    /* From here on, whatever happens, the originals go back on exit */
+    bulk_applied = 1;
+    atexit(bulk_restore);
+    
+    for (int i = 0; i < count; i++) {
+        const char* argv[] = {"git", "config", "--local", bulk_overrides[i].key,
+                              bulk_overrides[i].value, NULL};
+        if (!run_git(argv)) {
+            fprintf(stderr, "Error: Failed to set %s\n", bulk_overrides[i].key);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------- */
+/* Rate limiting: a token bucket that backs off when git or the host slows */
+/* ---------------------------------------------------------------------- */
+
+#define RATE_LATENCY_BACKOFF 3.0 /* Back off when latency triples... */
+#define RATE_LATENCY_NOISE 0.002 /* ...and is above 2 ms (in-process jitter) */
+#define RATE_MIN_SCALE 0.05      /* Go down to 5% of the configured speed */
+#define RATE_ADJUST_INTERVAL 0.25
+
+/*
+ * rate is in commits (or days, with per_day) per second, 0 for no cap.
+ * scale shrinks when the smoothed commit latency climbs well above the
+ * best seen so far or the load average exceeds the CPU count, and grows
+ * back slowly once things calm down. With no cap, a reduced scale turns
+ * into a duty cycle: idle time proportional to the measured latency.
+ */
+typedef struct {
+    double rate;
+    int per_day;
+    int adaptive;
+    double tokens;
+    double last_refill;
+    double scale;
+    double latency;
+    double latency_floor;
+    int samples;
+    double last_adjust;
+    long cpus;
+} RateLimiter;
+
+/**
+ * Sleep for a fractional number of seconds
+ * @param seconds: Time to sleep, ignored if not positive
+ */
+void sleep_seconds(double seconds) {
+    struct timespec pause;
+    
+    if (seconds <= 0) {
+        return;
+    }
+    pause.tv_sec = (time_t)seconds;
+    pause.tv_nsec = (long)((seconds - pause.tv_sec) * 1e9);
+    nanosleep(&pause, NULL);
+}
+
+/**
+ * Set up a limiter
+ * @param limiter: Limiter to initialize
+ * @param rate: Units per second, 0 for no cap
+ * @param per_day: 1 if a unit is a day, 0 if it is a commit
+ * @param adaptive: 1 to back off under load
+ */
+void rate_limiter_init(RateLimiter* limiter, double rate, int per_day, int adaptive) {
+    memset(limiter, 0, sizeof(*limiter));
+    limiter->rate = rate;
+    limiter->per_day = per_day;
+    limiter->adaptive = adaptive;
+    limiter->tokens = 1;
+    limiter->scale = 1;
+    limiter->last_refill = monotonic_seconds();
+    limiter->last_adjust = limiter->last_refill;
+    limiter->cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (limiter->cpus < 1) {
+        limiter->cpus = 1;
+    }
+}
+
+/**
+ * Wait until the next units of work may start
+ * @param limiter: Limiter
+ * @param units: Commits or days about to be processed
+ */
+void rate_limiter_acquire(RateLimiter* limiter, double units) {
+    double now;
+    double rate = limiter->rate * limiter->scale;
+    
+    if (limiter->rate <= 0) {
+        if (limiter->scale < 1) {
+            sleep_seconds(limiter->latency * (1 / limiter->scale - 1));
+        }
+        return;
+    }
+    
+    now = monotonic_seconds();
+    limiter->tokens += (now - limiter->last_refill) * rate;
+    /* Allow at most one second worth of burst */
+    if (limiter->tokens > (rate > 1 ? rate : 1)) {
+        limiter->tokens = rate > 1 ? rate : 1;
+    }
+    limiter->last_refill = now;
+    if (limiter->tokens < units) {
+        sleep_seconds((units - limiter->tokens) / rate);
+        limiter->last_refill = monotonic_seconds();
+        limiter->tokens = units;
+    }
+    limiter->tokens -= units;
+}
+
+/**
+ * Feed one measured commit latency into the adaptive back-off
+ * @param limiter: Limiter
+ * @param seconds: Time the backend took for the commit
+ */
+void rate_limiter_record(RateLimiter* limiter, double seconds) {
+    double now;
+    double load = 0;
+    int overloaded;
+    
+    if (!limiter->adaptive) {
+        return;
+    }
+    limiter->latency = limiter->samples ? 0.8 * limiter->latency + 0.2 * seconds : seconds;
+    limiter->samples++;
+    if (limiter->samples >= 8 &&
+        (limiter->latency_floor == 0 || limiter->latency < limiter->latency_floor)) {
+        limiter->latency_floor = limiter->latency;
+    }
+    
+    now = monotonic_seconds();
+    if (now - limiter->last_adjust < RATE_ADJUST_INTERVAL) {
+        return;
+    }
+    limiter->last_adjust = now;
+    
+    getloadavg(&load, 1);
+    overloaded = load > limiter->cpus ||
+                 (limiter->latency_floor > 0 && limiter->latency > RATE_LATENCY_NOISE &&
+                  limiter->latency > RATE_LATENCY_BACKOFF * limiter->latency_floor);
+    if (overloaded) {
+        limiter->scale /= 2;
+        if (limiter->scale < RATE_MIN_SCALE) {
+            limiter->scale = RATE_MIN_SCALE;
+        }
+    } else if (limiter->scale < 1) {
+        limiter->scale += 0.05;
+        if (limiter->scale > 1) {
+            limiter->scale = 1;
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Finalize: one repack and the read-side indexes, after the whole run     */
+/* ---------------------------------------------------------------------- */
+
+/* The parts of `git count-objects -v` the report needs */
+typedef struct {
+    long loose_count;
+    long loose_kib;
+    long packed_count;
+    long packed_kib;
+    long packs;
+} ObjectCounts;
+
+/**
+ * Read object counts and sizes with `git count-objects -v`
+ * @param counts: Output counts
+ * @return: 1 on success, 0 on failure
+ */
+int read_object_counts(ObjectCounts* counts) {
+    const char* argv[] = {"git", "count-objects", "-v", NULL};
+    char line[MAX_COMMAND_LENGTH];
+    pid_t pid;
+    FILE* pipe = git_open(argv, "r", 0, &pid);
+    
+    memset(counts, 0, sizeof(*counts));
+    if (!pipe) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), pipe)) {
+        sscanf(line, "count: %ld", &counts->loose_count);
+        sscanf(line, "size: %ld", &counts->loose_kib);
+        sscanf(line, "in-pack: %ld", &counts->packed_count);
+        sscanf(line, "size-pack: %ld", &counts->packed_kib);
+        sscanf(line, "packs: %ld", &counts->packs);
+    }
+    return git_close(pipe, pid) == 0;
+}
+
+/**
+ * Print one line of the finalize report
+ * @param label: Line label
+ * @param counts: Counts to print
+ */
+void print_object_counts(const char* label, const ObjectCounts* counts) {
+    printf("  %-7s %8ld loose (%7.1f MiB)  %8ld packed in %ld pack(s) (%7.1f MiB)\n",
+           label, counts->loose_count, counts->loose_kib / 1024.0,
+           counts->packed_count, counts->packs, counts->packed_kib / 1024.0);
+}
+
+/**
+ * Repack everything into one delta-compressed pack with a multi-pack-index
+ * and reachability bitmaps, then write a commit-graph
+ * @return: 1 on success, 0 on failure
+ */
+int finalize_repository() {
+    /* window/depth match `git gc --aggressive`'s depth with a cheaper window */
+    const char* repack_argv[] = {"git", "repack", "-a", "-d", "-q", "--window=50", "--depth=50",
+                                 "--write-bitmap-index", "--write-midx", NULL};
+    /* Generation numbers and changed-path Bloom filters for log and merge-base */
+    const char* graph_argv[] = {"git", "commit-graph", "write", "--reachable",
+                                "--changed-paths", NULL};
+    ObjectCounts before, after;
+    
+    printf("\nFinalizing repository...\n");
+    if (!read_object_counts(&before)) {
+        fprintf(stderr, "Error: Failed to count objects\n");
+        return 0;
+    }
+    
+    if (!run_git(repack_argv)) {
+        fprintf(stderr, "Error: git repack failed\n");
+        return 0;
+    }
+    if (!run_git(graph_argv)) {
+        fprintf(stderr, "Error: git commit-graph write failed\n");
+        return 0;
+    }
+    
+    if (!read_object_counts(&after)) {
+        fprintf(stderr, "Error: Failed to count objects\n");
+        return 0;
+    }
+    print_object_counts("Before:", &before);
+    print_object_counts("After:", &after);
+    return 1;
+}
+
+/**
+ * Extract the generated branch into a directory, without an index
+ * @param directory: Where the files go; created if missing
+ * @return: 1 on success, 0 on failure
+ */
+int checkout_files(const char* directory) {
+    char treeish[MAX_REF_LENGTH];
+    const char* archive_argv[] = {"git", "archive", "--format=tar", treeish, NULL};
+    const char* tar_argv[] = {"tar", "-xf", "-", "-C", directory, NULL};
+    pid_t archive, tar;
+    int fds[2];
+    int archive_status, tar_status;
+    
+    snprintf(treeish, sizeof(treeish), "%s%s", target_branch ? "refs/heads/" : "",
+             target_branch ? target_branch : "HEAD");
+    printf("\nChecking out %s into %s...\n", treeish, directory);
+    mkdir(directory, 0777);
+    if (!cloexec_pipe(fds)) {
+        return 0;
+    }
+    /* git archive | tar -x, without a shell in between */
+    archive = spawn_process(git_path(), archive_argv, NULL, -1, fds[1], -1);
+    tar = spawn_process("tar", tar_argv, NULL, fds[0], -1, -1);
+    close(fds[0]);
+    close(fds[1]);
+    archive_status = archive > 0 ? wait_process(archive) : -1;
+    tar_status = tar > 0 ? wait_process(tar) : -1;
+    if (archive_status != 0 || tar_status != 0) {
+        fprintf(stderr, "Error: Failed to check out into %s\n", directory);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Build the path of the activity file a date's entries go to
+ * @param layout: Content layout
+ * @param date: Date of the entry
+ * @param path: Output buffer
+ * @param max_length: Size of the output buffer
+ */
+void activity_path(Layout layout, const Date* date, char* path, int max_length) {
+    switch (layout) {
+    case LAYOUT_YEAR:
+        snprintf(path, max_length, "%s/%04d.txt", DATA_DIR, date->year);
+        break;
+    case LAYOUT_MONTH:
+        snprintf(path, max_length, "%s/%04d-%02d.txt", DATA_DIR, date->year, date->month);
+        break;
+    default:
+        snprintf(path, max_length, "%s", DATA_FILE);
+        break;
+    }
+}
+
+/* ---------------------------------------------------------------------- */
+/* Plan: the whole schedule, decided before any git work starts            */
+/* ---------------------------------------------------------------------- */
+
+/*
+ * One row per commit, in commit order, stored as columns in a single arena
+ * allocation (about 18 bytes a commit). Building it touches no git state,
+ * so it can be printed (--dry-run), sized and timed before executing.
+ */
+typedef struct {
+    int64_t count;           /* Commits planned */
+    int64_t active_days;     /* Days with at least one commit */
+    uint64_t content_bytes;  /* Activity text appended over the whole run */
+    int64_t* when;           /* Commit time, seconds since the epoch */
+    int32_t* day;            /* Epoch day of the commit */
+    int16_t* tz_offset;      /* Local UTC offset, in minutes */
+    uint8_t* number;         /* Commit number within its day, from 1 */
+    uint8_t* message;        /* Index into commit_messages */
+    uint8_t* session;        /* Minutes of development work */
+    uint8_t* lines;          /* Lines modified */
+    void* arena;
+} Plan;
+
+/**
+ * Local UTC offset in effect during a day's working hours
+ * @param date: Day to look up
+ * @return: Offset in minutes east of UTC
+ */
+int local_utc_offset(const Date* date) {
+    struct tm tm = {0};
+    
+    /* DST switches happen at night, commits are between 8 AM and 10 PM */
+    tm.tm_year = date->year - 1900;
+    tm.tm_mon = date->month - 1;
+    tm.tm_mday = date->day;
+    tm.tm_hour = 12;
+    tm.tm_isdst = -1;
+    mktime(&tm);
+    return (int)(tm.tm_gmtoff / 60);
+}
+
+/**
+ * Draw the number of commits for a day
+ * @param seed: Run seed
+ * @param day: Epoch day
+ * @param max_commits_per_day: Upper bound
+ * @return: 0 to max_commits_per_day
+ */
+int plan_commits_on(uint64_t seed, int64_t day, int max_commits_per_day) {
+    RandomStream random;
+    Date date;
+    
+    /* Sometimes developers don't commit every day - that's normal! */
+    civil_from_days(day, &date);
+    random_stream(&random, seed, &date, 0);
+    return random_below(&random, RANDOM_COMMIT_COUNT, max_commits_per_day + 1);
+}
+
+/**
+ * Decide every commit of a run
+ * @param plan: Output plan
+ * @param seed: Run seed
+ * @param start_day: First epoch day, inclusive
+ * @param end_day: Last epoch day, inclusive
+ * @param max_commits_per_day: Upper bound on commits per day
+ * @return: 1 on success, 0 on failure
+ */
+int build_plan(Plan* plan, uint64_t seed, int64_t start_day, int64_t end_day,
+               int max_commits_per_day) {
+    int64_t row = 0;
+    char* arena;
+    
+    memset(plan, 0, sizeof(*plan));
+    
+    /* First pass: only the per-day counts, to size the arena exactly */
+    for (int64_t day = start_day; day <= end_day; day++) {
+        int commits_today = plan_commits_on(seed, day, max_commits_per_day);
+        plan->count += commits_today;
+        plan->active_days += commits_today > 0;
+    }
+    
+    /* Widest columns first keeps every column naturally aligned */
+    arena = malloc(plan->count * (sizeof(int64_t) + sizeof(int32_t) + sizeof(int16_t) + 4) + 1);
+    if (!arena) {
+        fprintf(stderr, "Error: Out of memory for a %lld commit plan\n", (long long)plan->count);
+        return 0;
+    }
+    plan->arena = arena;
+    plan->when = (int64_t*)arena;
+    plan->day = (int32_t*)(plan->when + plan->count);
+    plan->tz_offset = (int16_t*)(plan->day + plan->count);
+    plan->number = (uint8_t*)(plan->tz_offset + plan->count);
+    plan->message = plan->number + plan->count;
+    plan->session = plan->message + plan->count;
+    plan->lines = plan->session + plan->count;
+    
+    /* Second pass: fill in the rows */
+    for (int64_t day = start_day; day <= end_day; day++) {
+        int commits_today = plan_commits_on(seed, day, max_commits_per_day);
+        int tz_offset;
+        Date date;
+        
+        if (commits_today == 0) {
+            continue;
+        }
+        civil_from_days(day, &date);
+        tz_offset = local_utc_offset(&date);
+        
+        for (int i = 1; i <= commits_today; i++) {
+            RandomStream random;
+            char entry[MAX_ENTRY_LENGTH];
+            int hour, minute;
+            
+            random_stream(&random, seed, &date, i);
+            plan->number[row] = (uint8_t)i;
+            plan->day[row] = (int32_t)day;
+            plan->tz_offset[row] = (int16_t)tz_offset;
+            plan->session[row] = random_below(&random, RANDOM_SESSION, 180) + 30; /* 30-210 minutes */
+            plan->lines[row] = random_below(&random, RANDOM_LINES, 100) + 10;     /* 10-110 lines */
+            plan->message[row] = generate_commit_message(&random);
+            
+            /* Spread throughout the day */
+            hour = random_below(&random, RANDOM_HOUR, 14) + 8; /* Between 8 AM and 10 PM */
+            minute = random_below(&random, RANDOM_MINUTE, 60);
+            plan->when[row] = day * 86400 + hour * 3600 + minute * 60 - tz_offset * 60;
+            
+            plan->content_bytes += format_activity_entry(entry, sizeof(entry), &date, i,
+                                                         plan->session[row], plan->lines[row]);
+            row++;
+        }
+    }
+    return 1;
 }
 
 /**
- * Get the number of days in a month
- * @param month: Month (1-12)
- * @param year: Year
- * @return: Number of days in the month
+ * Expand one plan row into a commit for the backends
+ * @param plan: Plan
+ * @param row: Row index
+ * @param layout: Content layout, for the activity file path
+ * @param commit: Output commit
  */
-int days_in_month(int month, int year) {
-    int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-    if (month == 2 && is_leap_year(year)) {
-        return 29;
-    }
-    return days[month - 1];
+void plan_commit(const Plan* plan, int64_t row, Layout layout, Commit* commit) {
+    int64_t local = plan->when[row] + plan->tz_offset[row] * 60;
+    
+    civil_from_days(plan->day[row], &commit->date);
+    commit->number = plan->number[row];
+    commit->hour = (int)(local % 86400 / 3600);
+    commit->minute = (int)(local % 3600 / 60);
+    commit->when = plan->when[row];
+    commit->tz_offset = plan->tz_offset[row];
+    commit->message = commit_messages[plan->message[row]];
+    activity_path(layout, &commit->date, commit->path, sizeof(commit->path));
+    commit->entry_length = format_activity_entry(commit->entry, sizeof(commit->entry),
+                                                 &commit->date, commit->number,
+                                                 plan->session[row], plan->lines[row]);
 }
 
 /**
- * Increment a date by one day
- * @param date: Date structure to increment
+ * Print every planned commit, for --dry-run
+ * @param plan: Plan to print
+ * @param layout: Content layout
  */
-void increment_date(Date* date) {
-    date->day++;
-    
-    if (date->day > days_in_month(date->month, date->year)) {
-        date->day = 1;
-        date->month++;
-        
-        if (date->month > 12) {
-            date->month = 1;
-            date->year++;
-        }
+void print_plan(const Plan* plan, Layout layout) {
+    for (int64_t row = 0; row < plan->count; row++) {
+        Commit commit;
+        plan_commit(plan, row, layout, &commit);
+        printf("%04d-%02d-%02d %02d:%02d %c%02d%02d #%-2d %3d min %3d lines  %-32s %s\n",
+               commit.date.year, commit.date.month, commit.date.day, commit.hour, commit.minute,
+               commit.tz_offset < 0 ? '-' : '+', abs(commit.tz_offset) / 60,
+               abs(commit.tz_offset) % 60, commit.number, plan->session[row], plan->lines[row],
+               commit.message, commit.path);
     }
 }
 
 /**
- * Compare two dates
- * @param date1: First date
- * @param date2: Second date
- * @return: -1 if date1 < date2, 0 if equal, 1 if date1 > date2
+ * Release a plan
+ * @param plan: Plan to free
  */
-int compare_dates(const Date* date1, const Date* date2) {
-    if (date1->year != date2->year) {
-        return (date1->year < date2->year) ? -1 : 1;
-    }
-    if (date1->month != date2->month) {
-        return (date1->month < date2->month) ? -1 : 1;
-    }
-    if (date1->day != date2->day) {
-        return (date1->day < date2->day) ? -1 : 1;
-    }
-    return 0;
+void free_plan(Plan* plan) {
+    free(plan->arena);
+    memset(plan, 0, sizeof(*plan));
 }
 
 /**
- * Initialize Git repository if it doesn't exist
+ * Create a single commit that looks legitimate to hiring algorithms
+ * @param options: Backend and layout to use
+ * @param plan: Plan of the run
+ * @param row: Plan row of the commit
  * @return: 1 on success, 0 on failure
  */
-int init_git_repo() {
-    struct stat st = {0};
+int create_commit(const Options* options, const Plan* plan, int64_t row) {
+    uint64_t started = trace.path ? monotonic_nanoseconds() : 0;
+    Commit commit;
     
-    /* Check if .git directory exists */
-    if (stat(".git", &st) == -1) {
-        printf("Initializing Git repository...\n");
-        int result = system("git init");
-        if (result != 0) {
-            fprintf(stderr, "Error: Failed to initialize Git repository\n");
+    stats_phase(PHASE_ENTRY);
+    /* Keep the worker pool a window of rows ahead of the commits */
+    while (workers_have_room() && (int64_t)workers.published < plan->count) {
+        plan_commit(plan, (int64_t)workers.published, options->layout, &commit);
+        if (!workers_submit(&commit)) {
             return 0;
         }
-        
-        /* Set up initial commit */
-        system("git config user.name \"Cyclops\" 2>/dev/null || true");
-        system("git config user.email \"cyclops@github.com\" 2>/dev/null || true");
     }
-    
+    plan_commit(plan, row, options->layout, &commit);
+    journal_next(row, &commit);
+    if (!options->backend->add_commit(&commit)) {
+        return 0;
+    }
+    stats_record();
+    if (trace.path) {
+        trace_add(TRACE_COMMIT, "commit", started, monotonic_nanoseconds(), 0, row, commit.number);
+    }
     return 1;
 }
 
 /**
- * Generate realistic commit messages that recruiters expect
- * @param message: Buffer to store the message
- * @param max_length: Maximum length of the message
- */
-void generate_commit_message(char* message, int max_length) {
-    const char* messages[] = {
-        "Refactor authentication module",
-        "Add comprehensive unit tests",
-        "Optimize database queries",
-        "Fix memory leak in parser",
-        "Implement rate limiting middleware",
-        "Update API documentation",
-        "Add input validation layer",
-        "Improve error handling",
-        "Optimize build pipeline",
-        "Add monitoring metrics",
-        "Implement caching strategy",
-        "Fix cross-platform compatibility",
-        "Add security headers",
-        "Optimize image compression",
-        "Implement async processing",
-        "Add logging framework",
-        "Fix race condition bug",
-        "Update dependency versions",
-        "Add feature toggles",
-        "Implement data migration",
-        "Add integration tests",
-        "Fix CSS responsiveness",
-        "Optimize network requests",
-        "Add encryption support"
-    };
-    
-    int num_messages = sizeof(messages) / sizeof(messages[0]);
-    int index = rand() % num_messages;
-    
-    snprintf(message, max_length, "%s", messages[index]);
-}
-
-/**
- * Create a single commit that looks legitimate to hiring algorithms
- * @param date: Date for the commit
- * @param commit_number: Number of the commit for this date
- * @return: 1 on success, 0 on failure
+ * Format a duration for progress output
+ * @param seconds: Duration
+ * @param text: Output buffer
+ * @param max_length: Size of the output buffer
  */
-int create_commit(const Date* date, int commit_number) {
-    char command[MAX_COMMAND_LENGTH];
-    char message[MAX_MESSAGE_LENGTH];
-    char date_str[MAX_DATE_LENGTH];
-    FILE* file;
-    
-    /* Create/update the activity file with realistic content */
-    file = fopen(DATA_FILE, "a");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot open activity file\n");
-        return 0;
-    }
-    
-    /* Write realistic development activity data */
-    fprintf(file, "// Activity log: %04d-%02d-%02d #%d\n", 
-            date->year, date->month, date->day, commit_number);
-    fprintf(file, "// Session: %d minutes of development work\n", 
-            (rand() % 180) + 30); /* 30-210 minutes */
-    fprintf(file, "// Changes: %d lines modified\n", 
-            (rand() % 100) + 10); /* 10-110 lines */
-    fprintf(file, "/* Generated activity to demonstrate the meaninglessness of GitHub metrics */\n\n");
-    fclose(file);
-    
-    /* Add file to git */
-    snprintf(command, sizeof(command), "git add %s", DATA_FILE);
-    if (system(command) != 0) {
-        fprintf(stderr, "Error: Failed to add file to git\n");
-        return 0;
-    }
-    
-    /* Generate realistic commit message */
-    generate_commit_message(message, sizeof(message));
+void format_duration(double seconds, char* text, int max_length) {
+    long total = (long)(seconds + 0.5);
     
-    /* Create commit with specific date - spread throughout the day */
-    int hour = rand() % 14 + 8; /* Between 8 AM and 10 PM */
-    int minute = rand() % 60;
-    
-    snprintf(date_str, sizeof(date_str), "%04d-%02d-%02d %02d:%02d:00", 
-             date->year, date->month, date->day, hour, minute);
-    
-    snprintf(command, sizeof(command), 
-             "GIT_COMMITTER_DATE=\"%s\" git commit --date=\"%s\" -m \"%s\"",
-             date_str, date_str, message);
-    
-    if (system(command) != 0) {
-        fprintf(stderr, "Error: Failed to create commit\n");
-        return 0;
+    if (total >= 3600) {
+        snprintf(text, max_length, "%ldh%02ldm", total / 3600, total % 3600 / 60);
+    } else if (total >= 60) {
+        snprintf(text, max_length, "%ldm%02lds", total / 60, total % 60);
+    } else {
+        snprintf(text, max_length, "%lds", total);
     }
-    
-    return 1;
 }
 
 /**
@@ -269,14 +5302,76 @@ void print_banner() {
  * @param program_name: Name of the program
  */
 void print_usage(const char* program_name) {
+    int count = sizeof(backends) / sizeof(backends[0]);
+    
     print_banner();
-    printf("Usage: %s <start_date> <end_date> <max_commits_per_day>\n", program_name);
+    printf("Usage: %s [options] <start_date> <end_date> <max_commits_per_day>\n", program_name);
+    printf("       %s [options] --manifest=FILE\n", program_name);
+    printf("       %s [options] --resume\n", program_name);
     printf("\n");
     printf("Arguments:\n");
     printf("  start_date          Start date in YYYY-MM-DD format\n");
     printf("  end_date           End date in YYYY-MM-DD format\n");
     printf("  max_commits_per_day Maximum commits per day (1-20 recommended)\n");
     printf("\n");
+    printf("Options:\n");
+    printf("  --backend=NAME      How commits are written (default: %s)\n", backends[0].name);
+    for (int i = 0; i < count; i++) {
+        printf("      %-15s %s\n", backends[i].name, backends[i].description);
+    }
+    printf("  --layout=LAYOUT     Where activity entries are stored:\n");
+    printf("      single          one growing %s (default)\n", DATA_FILE);
+    printf("      year            one %s/YYYY.txt per year\n", DATA_DIR);
+    printf("      month           one %s/YYYY-MM.txt per month\n", DATA_DIR);
+    printf("                      Sharded layouts keep every commit's new blob small\n");
+    printf("  --seed=N            Seed for a repeatable run (default: time based, printed)\n");
+    printf("  --bulk              Suspend gc, hooks and per-object fsync for this run;\n");
+    printf("                      the repository config is restored on exit\n");
+    printf("  --finalize          After the run, repack once and write a commit-graph,\n");
+    printf("                      reachability bitmaps and a multi-pack-index\n");
+    printf("  --rate=N[c|d]       Cap at N commits (c) or days (d) per second, backing\n");
+    printf("                      off when git latency or system load rises; 0 means\n");
+    printf("                      unlimited. Default: unlimited, with load back-off for\n");
+    printf("                      the porcelain backend only\n");
+    printf("  --dry-run           Print the planned commits without touching git\n");
+    printf("  --branch=NAME       Extend NAME instead of the checked-out branch; the\n");
+    printf("                      working tree and index are left alone\n");
+    printf("  --checkpoint=N      Also update the branch every N commits, so an\n");
+    printf("                      aborted run keeps its progress\n");
+    printf("  --resume            Carry on with the last run recorded in the target's\n");
+    printf("                      %s, at the commit after the one its branch\n", JOURNAL_FILE);
+    printf("                      points at; no dates or max are given\n");
+    printf("  --git-dir=DIR       Write objects into the repository at DIR (created bare\n");
+    printf("                      if missing); no working tree files are written\n");
+    printf("  --bare              Same as --git-dir=. for a bare repository\n");
+    printf("  --checkout=DIR      After the run, extract the branch's files into DIR\n");
+    printf("  --queue-depth=N     Objects hashed ahead of the writer thread for the\n");
+    printf("                      objects, pack, plumbing and batch backends\n");
+    printf("                      (default: %d with more than one CPU, else 0);\n",
+           DEFAULT_QUEUE_DEPTH);
+    printf("                      0 stores each object inline\n");
+    printf("  --jobs=N            Hash (and for objects/plumbing, store) activity blobs\n");
+    printf("                      on N threads while commits are chained in order;\n");
+    printf("                      the result is identical for any N (default: 1)\n");
+    printf("  --manifest=FILE     Run one job per line of FILE, \"path start end max\n");
+    printf("                      [seed]\", each in its own directory (created if\n");
+    printf("                      missing) with the options given here\n");
+    printf("  --parallel=N        Manifest jobs run at once (default: online CPUs)\n");
+    printf("  --shared-objects=DIR  Store objects in DIR, listed as an alternate of the\n");
+    printf("                      target, so targets with the same history share\n");
+    printf("                      them; objects already in DIR are not written again\n");
+    printf("  --bundle=FILE       Write a new history as a git bundle (one pack) to FILE\n");
+    printf("                      instead of a repository; --branch names its branch\n");
+    printf("                      (default: main). Use it with git clone or git fetch\n");
+    printf("  --stats[=FORMAT]    Time each phase of every commit (entry, append, add,\n");
+    printf("                      commit, ref) and report percentiles at the end:\n");
+    printf("      text            a table under the summary (default)\n");
+    printf("      json            the run report as one line of JSON on stdout; all\n");
+    printf("                      other output goes to stderr\n");
+    printf("  --trace=FILE        Write a Chrome trace-event timeline of the run to FILE\n");
+    printf("                      at exit (Perfetto, chrome://tracing): days, commits,\n");
+    printf("                      their phases and every git process\n");
+    printf("\n");
     printf("Example:\n");
     printf("  %s 2024-01-01 2024-12-31 5\n", program_name);
     printf("\n");
@@ -285,92 +5380,552 @@ void print_usage(const char* program_name) {
 }
 
 /**
- * Main function - The eye that sees through the hiring charade
+ * Parse the --options that precede the positional arguments
+ * @param argc: Argument count from main
+ * @param argv: Argument vector from main
+ * @param options: Output options, defaults applied
+ * @return: Index of the first positional argument, or -1 on error
  */
-int main(int argc, char* argv[]) {
+int parse_options(int argc, char* argv[], Options* options) {
+    enum { OPT_BACKEND = 256, OPT_LAYOUT, OPT_SEED, OPT_BULK, OPT_FINALIZE, OPT_RATE, OPT_DRY_RUN,
+           OPT_BRANCH, OPT_CHECKPOINT, OPT_GIT_DIR, OPT_BARE, OPT_CHECKOUT, OPT_QUEUE_DEPTH,
+           OPT_JOBS, OPT_MANIFEST, OPT_PARALLEL, OPT_SHARED_OBJECTS, OPT_BUNDLE,
+           OPT_RESUME, OPT_STATS, OPT_TRACE };
+    static const struct option long_options[] = {
+        {"backend", required_argument, NULL, OPT_BACKEND},
+        {"layout", required_argument, NULL, OPT_LAYOUT},
+        {"seed", required_argument, NULL, OPT_SEED},
+        {"bulk", no_argument, NULL, OPT_BULK},
+        {"finalize", no_argument, NULL, OPT_FINALIZE},
+        {"rate", required_argument, NULL, OPT_RATE},
+        {"dry-run", no_argument, NULL, OPT_DRY_RUN},
+        {"branch", required_argument, NULL, OPT_BRANCH},
+        {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+        {"git-dir", required_argument, NULL, OPT_GIT_DIR},
+        {"bare", no_argument, NULL, OPT_BARE},
+        {"checkout", required_argument, NULL, OPT_CHECKOUT},
+        {"queue-depth", required_argument, NULL, OPT_QUEUE_DEPTH},
+        {"jobs", required_argument, NULL, OPT_JOBS},
+        {"manifest", required_argument, NULL, OPT_MANIFEST},
+        {"parallel", required_argument, NULL, OPT_PARALLEL},
+        {"shared-objects", required_argument, NULL, OPT_SHARED_OBJECTS},
+        {"bundle", required_argument, NULL, OPT_BUNDLE},
+        {"resume", no_argument, NULL, OPT_RESUME},
+        {"stats", optional_argument, NULL, OPT_STATS},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {NULL, 0, NULL, 0}
+    };
+    int option;
+    int has_backend = 0;
+    int has_layout = 0;
+    
+    options->backend = &backends[0];
+    options->layout = LAYOUT_SINGLE;
+    options->has_seed = 0;
+    options->bulk = 0;
+    options->finalize = 0;
+    options->has_rate = 0;
+    options->dry_run = 0;
+    options->branch = NULL;
+    options->checkpoint = 0;
+    options->git_dir = NULL;
+    options->checkout = NULL;
+    options->queue_depth = queue_depth;
+    options->jobs = hash_jobs;
+    options->manifest = NULL;
+    options->shared_objects = NULL;
+    options->bundle = NULL;
+    options->resume = 0;
+    options->stats = STATS_NONE;
+    options->trace = NULL;
+    options->parallel = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (options->parallel < 1) {
+        options->parallel = 1;
+    }
+    
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+        case OPT_BACKEND:
+            options->backend = find_backend(optarg);
+            if (!options->backend) {
+                fprintf(stderr, "Error: Unknown backend '%s'\n", optarg);
+                return -1;
+            }
+            has_backend = 1;
+            break;
+        case OPT_LAYOUT:
+            if (strcmp(optarg, "single") == 0) {
+                options->layout = LAYOUT_SINGLE;
+            } else if (strcmp(optarg, "year") == 0) {
+                options->layout = LAYOUT_YEAR;
+            } else if (strcmp(optarg, "month") == 0) {
+                options->layout = LAYOUT_MONTH;
+            } else {
+                fprintf(stderr, "Error: Unknown layout '%s'\n", optarg);
+                return -1;
+            }
+            has_layout = 1;
+            break;
+        case OPT_SEED:
+            if (!parse_seed(optarg, &options->seed)) {
+                fprintf(stderr, "Error: --seed takes a number from 0 to %llu\n",
+                        (unsigned long long)UINT64_MAX);
+                return -1;
+            }
+            options->has_seed = 1;
+            break;
+        case OPT_BULK:
+            options->bulk = 1;
+            break;
+        case OPT_FINALIZE:
+            options->finalize = 1;
+            break;
+        case OPT_RATE: {
+            char* unit;
+            options->rate = strtod(optarg, &unit);
+            options->rate_per_day = *unit == 'd';
+            if (unit == optarg || options->rate < 0 ||
+                (*unit && strcmp(unit, "d") != 0 && strcmp(unit, "c") != 0)) {
+                fprintf(stderr, "Error: --rate takes N or Nc (commits/s) or Nd (days/s)\n");
+                return -1;
+            }
+            options->has_rate = 1;
+            break;
+        }
+        case OPT_DRY_RUN:
+            options->dry_run = 1;
+            break;
+        case OPT_BRANCH:
+            options->branch = optarg;
+            break;
+        case OPT_CHECKPOINT: {
+            char* end;
+            long interval = strtol(optarg, &end, 10);
+            if (end == optarg || *end || interval < 1 || interval != (int)interval) {
+                fprintf(stderr, "Error: --checkpoint takes a number of commits\n");
+                return -1;
+            }
+            options->checkpoint = (int)interval;
+            break;
+        }
+        case OPT_GIT_DIR:
+            options->git_dir = optarg;
+            break;
+        case OPT_BARE:
+            options->git_dir = ".";
+            break;
+        case OPT_CHECKOUT:
+            options->checkout = optarg;
+            break;
+        case OPT_QUEUE_DEPTH: {
+            char* end;
+            long depth = strtol(optarg, &end, 10);
+            if (end == optarg || *end || depth < 0 || depth > MAX_QUEUE_DEPTH) {
+                fprintf(stderr, "Error: --queue-depth takes 0 to %d objects\n", MAX_QUEUE_DEPTH);
+                return -1;
+            }
+            options->queue_depth = (int)depth;
+            break;
+        }
+        case OPT_JOBS: {
+            char* end;
+            long jobs = strtol(optarg, &end, 10);
+            if (end == optarg || *end || jobs < 1 || jobs > MAX_JOBS) {
+                fprintf(stderr, "Error: --jobs takes 1 to %d threads\n", MAX_JOBS);
+                return -1;
+            }
+            options->jobs = (int)jobs;
+            break;
+        }
+        case OPT_MANIFEST:
+            options->manifest = optarg;
+            break;
+        case OPT_SHARED_OBJECTS:
+            options->shared_objects = optarg;
+            break;
+        case OPT_BUNDLE:
+            options->bundle = optarg;
+            break;
+        case OPT_RESUME:
+            options->resume = 1;
+            break;
+        case OPT_STATS:
+            if (!optarg || strcmp(optarg, "text") == 0) {
+                options->stats = STATS_TEXT;
+            } else if (strcmp(optarg, "json") == 0) {
+                options->stats = STATS_JSON;
+            } else {
+                fprintf(stderr, "Error: --stats takes text or json\n");
+                return -1;
+            }
+            break;
+        case OPT_TRACE:
+            options->trace = optarg;
+            break;
+        case OPT_PARALLEL: {
+            char* end;
+            long parallel = strtol(optarg, &end, 10);
+            if (end == optarg || *end || parallel < 1 || parallel != (int)parallel) {
+                fprintf(stderr, "Error: --parallel takes a number of jobs\n");
+                return -1;
+            }
+            options->parallel = (int)parallel;
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    
+    /* A bundle is written by its own pack writer and touches no repository */
+    if (options->bundle) {
+        if (has_backend || options->checkpoint) {
+            fprintf(stderr, "Error: --bundle cannot be combined with --backend or --checkpoint\n");
+            return -1;
+        }
+        options->backend = &bundle_backend;
+    }
+    if (!options->backend->init && (options->git_dir || options->bulk || options->finalize ||
+                                    options->checkout || options->shared_objects ||
+                                    options->resume)) {
+        fprintf(stderr, "Error: The %s backend has no repository for --git-dir, --bare, --bulk, "
+                        "--finalize, --checkout, --shared-objects or --resume\n",
+                options->backend->name);
+        return -1;
+    }
+    /* Porcelain commits through the index, so it can only extend HEAD */
+    if (strcmp(options->backend->name, "porcelain") == 0 &&
+        (options->branch || options->checkpoint || options->git_dir)) {
+        fprintf(stderr, "Error: --branch, --checkpoint, --git-dir and --bare need a backend "
+                        "other than porcelain\n");
+        return -1;
+    }
+    /* The journal fixes the plan and the branch, and porcelain keeps none */
+    if (options->resume && (options->has_seed || has_layout || options->branch)) {
+        fprintf(stderr, "Error: --resume takes the seed, dates, layout and branch from the journal\n");
+        return -1;
+    }
+    if (options->resume && (options->manifest || options->dry_run ||
+                            strcmp(options->backend->name, "porcelain") == 0)) {
+        fprintf(stderr, "Error: --resume cannot be combined with --manifest, --dry-run "
+                        "or the porcelain backend\n");
+        return -1;
+    }
+    /* Repacking would treat the store as this target's alone */
+    if (options->shared_objects && options->finalize) {
+        fprintf(stderr, "Error: --finalize cannot be combined with --shared-objects\n");
+        return -1;
+    }
+    /* Manifest jobs keep only their errors, so a plan or report would go
+     * nowhere, and every job would write the same trace file */
+    if (options->manifest && (options->dry_run || options->stats || options->trace)) {
+        fprintf(stderr, "Error: --dry-run, --stats and --trace cannot be combined with --manifest\n");
+        return -1;
+    }
+    /* Only the in-process object writers hash blobs themselves */
+    if (options->jobs > 1 && (strcmp(options->backend->name, "porcelain") == 0 ||
+                              strcmp(options->backend->name, "fast-import") == 0)) {
+        fprintf(stderr, "Error: --jobs needs the objects, pack, plumbing, batch or memory backend\n");
+        return -1;
+    }
+    return optind;
+}
+
+/* Benchmarks include this file for its helpers and bring their own main() */
+#ifndef CYCLOPS_NO_MAIN
+
+/**
+ * Generate one history in the current directory
+ * @param options: Parsed options
+ * @param start_text: Start date argument (NULL with --resume)
+ * @param end_text: End date argument (NULL with --resume)
+ * @param max_text: Max commits per day argument (NULL with --resume)
+ * @return: Process exit status
+ */
+int run_cyclops(Options* options, const char* start_text, const char* end_text,
+                const char* max_text) {
     Date start_date, end_date, current_date;
+    int64_t start_day, end_day, total_days;
+    RateLimiter limiter;
+    Plan plan;
+    JournalResume resume;
+    char journal_plan[MAX_COMMAND_LENGTH];
+    char max_buffer[16];
+    struct rusage usage, children;
     int max_commits_per_day;
+    int64_t first_row = 0;
+    int64_t active_days = 0;
+    uint64_t day_started = 0;
+    char day_name[16] = "";
+    int day_commits = 0;
     int total_commits = 0;
     int days_processed = 0;
+    double started, elapsed;
+    FILE* report = NULL;
+    int report_fd;
     
-    /* Check command line arguments */
-    if (argc != 4) {
-        print_usage(argv[0]);
-        return 1;
+    /* The JSON report gets stdout to itself; everything else, git's output
+     * included, goes to stderr */
+    if (options->stats == STATS_JSON) {
+        fflush(stdout);
+        report_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        report = report_fd >= 0 ? fdopen(report_fd, "w") : NULL;
+        if (!report || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "Error: Cannot set up stdout for --stats=json\n");
+            return 1;
+        }
+    }
+    
+    /* Every git command below acts on the target, wherever we run from */
+    if (options->git_dir) {
+        git_dir = options->git_dir;
+        bare_target = 1;
+        setenv("GIT_DIR", git_dir, 1);
+    }
+    
+    /* The journal has the run's arguments and how far its branch got */
+    if (options->resume) {
+        if (!journal_read(git_dir, &resume)) {
+            return 1;
+        }
+        if (resume.complete) {
+            printf("Nothing to resume: the last run in %s/%s finished\n", git_dir, JOURNAL_FILE);
+            return 0;
+        }
+        start_text = resume.start;
+        end_text = resume.end;
+        snprintf(max_buffer, sizeof(max_buffer), "%d", resume.max_commits_per_day);
+        max_text = max_buffer;
+        options->seed = resume.seed;
+        options->has_seed = 1;
+        options->layout = resume.layout;
+        options->branch = resume.ref + strlen("refs/heads/");
+        first_row = resume.row;
+        resuming = 1;
     }
     
     /* Parse arguments */
-    if (!parse_date(argv[1], &start_date)) {
+    if (!parse_date(start_text, &start_date)) {
         fprintf(stderr, "Error: Invalid start date format. Use YYYY-MM-DD\n");
         return 1;
     }
     
-    if (!parse_date(argv[2], &end_date)) {
+    if (!parse_date(end_text, &end_date)) {
         fprintf(stderr, "Error: Invalid end date format. Use YYYY-MM-DD\n");
         return 1;
     }
     
-    max_commits_per_day = atoi(argv[3]);
+    max_commits_per_day = atoi(max_text);
     if (max_commits_per_day < 1 || max_commits_per_day > 50) {
         fprintf(stderr, "Error: max_commits_per_day must be between 1 and 50\n");
         return 1;
     }
     
     /* Validate date range */
-    if (compare_dates(&start_date, &end_date) > 0) {
+    start_day = days_from_civil(start_date.year, start_date.month, start_date.day);
+    end_day = days_from_civil(end_date.year, end_date.month, end_date.day);
+    total_days = end_day - start_day + 1;
+    if (start_day > end_day) {
         fprintf(stderr, "Error: Start date must be before or equal to end date\n");
         return 1;
     }
     
-    /* Initialize random seed */
-    srand(time(NULL));
+    /* Initialize random seed; it is printed below so any run can be repeated */
+    if (!options->has_seed) {
+        options->seed = splitmix64_mix((uint64_t)time(NULL) << 20 ^ (uint64_t)getpid()) >> 16;
+    }
+    
+    /* Decide every commit up front; nothing below changes the schedule */
+    if (!build_plan(&plan, options->seed, start_day, end_day, max_commits_per_day)) {
+        return 1;
+    }
+    
+    if (options->dry_run) {
+        print_plan(&plan, options->layout);
+        printf("\n%lld commits on %lld of %lld days, %.1f KiB of activity (seed %llu)\n",
+               (long long)plan.count, (long long)plan.active_days, (long long)total_days,
+               plan.content_bytes / 1024.0, (unsigned long long)options->seed);
+        free_plan(&plan);
+        return 0;
+    }
+    
+    /* Registered before bulk mode, so its restore is traced too */
+    if (options->trace) {
+        trace_open(options->trace);
+    }
     
-    /* Initialize Git repository */
-    if (!init_git_repo()) {
+    /* Initialize Git repository, for the backends that write to one */
+    bundle_path = options->bundle;
+    if (options->backend->init && !options->backend->init()) {
+        return 1;
+    }
+    snprintf(object_dir, sizeof(object_dir), "%s/objects", git_dir);
+    if (options->shared_objects && !setup_shared_objects(options->shared_objects)) {
         return 1;
     }
+    if (first_row > plan.count) {
+        fprintf(stderr, "Error: The journal is ahead of its own plan\n");
+        return 1;
+    }
+    /* Porcelain leaves commits to git commit, so it has nothing to record */
+    if (options->backend->init && strcmp(options->backend->name, "porcelain") != 0) {
+        snprintf(journal_plan, sizeof(journal_plan), "%llu %04d-%02d-%02d %04d-%02d-%02d %d %s %lld",
+                 (unsigned long long)options->seed, start_date.year, start_date.month,
+                 start_date.day, end_date.year, end_date.month, end_date.day,
+                 max_commits_per_day, layout_names[options->layout], (long long)first_row);
+        if (!journal_open(git_dir, journal_plan)) {
+            return 1;
+        }
+    }
+    target_branch = options->branch;
+    checkpoint_interval = options->checkpoint;
+    queue_depth = options->queue_depth;
+    hash_jobs = options->jobs;
     
     print_banner();
     printf("Generating GitHub activity to expose hiring algorithm flaws...\n");
-    printf("Date range: %04d-%02d-%02d to %04d-%02d-%02d\n",
+    printf("Date range: %04d-%02d-%02d to %04d-%02d-%02d (%lld days)\n",
            start_date.year, start_date.month, start_date.day,
-           end_date.year, end_date.month, end_date.day);
-    printf("Max commits per day: %d\n\n", max_commits_per_day);
+           end_date.year, end_date.month, end_date.day, (long long)total_days);
+    printf("Max commits per day: %d\n", max_commits_per_day);
+    printf("Seed: %llu\n", (unsigned long long)options->seed);
+    if (resuming) {
+        printf("Resuming at commit %lld of %lld\n", (long long)first_row + 1, (long long)plan.count);
+    }
+    printf("Plan: %lld commits on %lld active days, %.1f KiB of activity\n",
+           (long long)plan.count, (long long)plan.active_days, plan.content_bytes / 1024.0);
+    printf("Backend: %s\n", options->backend->name);
+    if (bare_target) {
+        printf("Target: %s (objects only, no working tree)\n", git_dir);
+    }
+    if (bundle_path) {
+        printf("Target: %s (bundle, no repository)\n", bundle_path);
+    }
+    if (shared_objects) {
+        printf("Objects: %s (shared)\n", shared_objects);
+    }
+    if (trace.path) {
+        printf("Trace: %s (written at exit)\n", trace.path);
+    }
+    printf("\n");
     
     printf("If this can fool hiring algorithms, maybe the problem isn't \n");
     printf("the candidates - it's the evaluation criteria.\n\n");
     
-    /* Process each date in the range */
-    current_date = start_date;
+    /* Stop cleanly at a commit boundary so finish() can still run */
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+    /* A git that exits early must surface as a write error, not kill us */
+    signal(SIGPIPE, SIG_IGN);
+    
+    if (options->bulk) {
+        if (!bulk_begin()) {
+            return 1;
+        }
+        printf("Bulk mode: gc, hooks and per-object fsync suspended for this run\n\n");
+    }
+    
+    if (options->backend->begin && !options->backend->begin()) {
+        return 1;
+    }
+    
+    /* Only the slow process-per-commit path needs protecting by default */
+    if (options->has_rate) {
+        rate_limiter_init(&limiter, options->rate, options->rate_per_day, options->rate > 0);
+    } else {
+        rate_limiter_init(&limiter, 0, 0, strcmp(options->backend->name, "porcelain") == 0);
+    }
     
-    while (compare_dates(&current_date, &end_date) <= 0) {
-        /* Generate random number of commits for this day (0 to max) */
-        /* Sometimes developers don't commit every day - that's normal! */
-        int commits_today = rand() % (max_commits_per_day + 1);
+    /* Execute the plan, one day's commits at a time */
+    stats.enabled = options->stats != STATS_NONE || trace.path;
+    workers_seek((size_t)first_row);
+    started = monotonic_seconds();
+    for (int64_t row = first_row; row < plan.count && !interrupted; row++) {
+        double commit_started, latency;
         
-        if (commits_today > 0) {
-            printf("Processing %04d-%02d-%02d: %d commits\n",
-                   current_date.year, current_date.month, current_date.day, commits_today);
+        if (row == first_row || plan.day[row] != plan.day[row - 1]) {
+            int64_t previous_day = row == 0 ? start_day - 1 : plan.day[row - 1];
+            int64_t commits_today = 1;
+            char eta[32] = "-";
             
-            /* Create commits for this day */
-            for (int i = 1; i <= commits_today; i++) {
-                if (!create_commit(&current_date, i)) {
-                    fprintf(stderr, "Failed to create commit %d for %04d-%02d-%02d\n",
-                            i, current_date.year, current_date.month, current_date.day);
-                    return 1;
+            /* A day's span runs until the next day starts, waits included */
+            if (trace.path) {
+                uint64_t now = monotonic_nanoseconds();
+                
+                if (day_name[0]) {
+                    trace_add(TRACE_DAY, day_name, day_started, now, 0, previous_day, day_commits);
                 }
+                day_started = now;
+            }
+            while (row + commits_today < plan.count && plan.day[row + commits_today] == plan.day[row]) {
+                commits_today++;
+            }
+            if (row > first_row) {
+                double elapsed = monotonic_seconds() - started;
+                format_duration(elapsed / (row - first_row) * (plan.count - row), eta, sizeof(eta));
             }
+            active_days++;
+            civil_from_days(plan.day[row], &current_date);
+            snprintf(day_name, sizeof(day_name), "%04d-%02d-%02d", current_date.year,
+                     current_date.month, current_date.day);
+            day_commits = (int)commits_today;
+            printf("Processing %04d-%02d-%02d: %lld commits  [%lld/%lld, ETA %s]\n",
+                   current_date.year, current_date.month, current_date.day,
+                   (long long)commits_today, (long long)row, (long long)plan.count, eta);
             
-            total_commits += commits_today;
+            if (limiter.per_day) {
+                rate_limiter_acquire(&limiter, plan.day[row] - previous_day);
+            }
         }
         
-        days_processed++;
-        
-        /* Move to next day */
-        increment_date(&current_date);
-        
-        /* Small delay to avoid overwhelming the system */
-        usleep(5000); /* 5ms delay */
+        if (!limiter.per_day) {
+            rate_limiter_acquire(&limiter, 1);
+        }
+        commit_started = monotonic_seconds();
+        if (!create_commit(options, &plan, row)) {
+            civil_from_days(plan.day[row], &current_date);
+            fprintf(stderr, "Failed to create commit %d for %04d-%02d-%02d\n",
+                    plan.number[row], current_date.year, current_date.month, current_date.day);
+            return 1;
+        }
+        latency = monotonic_seconds() - commit_started;
+        rate_limiter_record(&limiter, latency);
+        histogram_add(&stats.commits, (uint64_t)(latency * 1e9));
+        total_commits++;
+        days_processed = (int)(plan.day[row] - start_day + 1);
+    }
+    if (trace.path && day_name[0]) {
+        trace_add(TRACE_DAY, day_name, day_started, monotonic_nanoseconds(), 0,
+                  days_from_civil(current_date.year, current_date.month, current_date.day),
+                  day_commits);
+    }
+    if (!interrupted) {
+        days_processed = (int)total_days;
+    }
+    free_plan(&plan);
+    
+    if (options->backend->finish && !options->backend->finish()) {
+        return 1;
+    }
+    /* finish() publishes the branch for most backends */
+    stats_record();
+    elapsed = monotonic_seconds() - started;
+    if (!journal_close(!interrupted)) {
+        return 1;
+    }
+    pipeline_report();
+    
+    if (interrupted) {
+        fprintf(stderr, "\nInterrupted: kept the %d commits created so far\n", total_commits);
+        return 130;
+    }
+    
+    if (options->finalize && total_commits > 0 && !finalize_repository()) {
+        return 1;
+    }
+    
+    if (options->checkout && total_commits > 0 && !checkout_files(options->checkout)) {
+        return 1;
     }
     
     printf("\nCyclops has exposed the system!\n");
@@ -378,8 +5933,30 @@ int main(int argc, char* argv[]) {
     printf("Days processed: %d\n", days_processed);
     printf("Total commits created: %d\n", total_commits);
     if (total_commits > 0) {
-        printf("Average commits per active day: %.2f\n", 
-               (float)total_commits / (days_processed - (days_processed - total_commits)));
+        printf("Average commits per active day: %.2f\n", (double)total_commits / active_days);
+        /* Time on the main thread; pipelined backends finish objects later */
+        printf("Commit latency: p50 %.1f us, p99 %.1f us\n",
+               histogram_percentile(&stats.commits, 0.50) / 1e3,
+               histogram_percentile(&stats.commits, 0.99) / 1e3);
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    getrusage(RUSAGE_CHILDREN, &children);
+    /* Children only count once waited for; some backends never start git */
+    if (children.ru_maxrss > 0) {
+        printf("Peak RSS: %ld KiB (largest git process: %ld KiB)\n", usage.ru_maxrss,
+               children.ru_maxrss);
+    } else {
+        printf("Peak RSS: %ld KiB\n", usage.ru_maxrss);
+    }
+    if (options->stats == STATS_TEXT) {
+        print_stats_text();
+    }
+    if (shared_objects && (strcmp(options->backend->name, "fast-import") == 0 ||
+                           strcmp(options->backend->name, "porcelain") == 0)) {
+        printf("Shared objects: skipped by git itself, not counted\n");
+    } else if (shared_objects) {
+        printf("Shared objects: %lld already in the store, %.1f KiB not written again\n",
+               (long long)shared_hits, shared_bytes / 1024.0);
     }
     printf("\nYour GitHub graph is now green. Does this make you a better developer?\n");
     printf("Of course not. That's exactly the point.\n\n");
@@ -397,5 +5974,339 @@ int main(int argc, char* argv[]) {
     printf("• Learning ability and adaptability\n");
     printf("• NOT GitHub activity patterns\n\n");
     
+    if (report) {
+        fflush(stdout);
+        print_stats_json(report, options->backend->name, options->seed, days_processed,
+                         active_days, total_commits, elapsed, usage.ru_maxrss, children.ru_maxrss);
+        if (fclose(report) != 0) {
+            fprintf(stderr, "Error: Cannot write the --stats=json report\n");
+            return 1;
+        }
+    }
     return 0;
 }
+
+/* One line of a --manifest file */
+typedef struct {
+    int line;
+    char path[MAX_PATH_LENGTH];
+    char start[MAX_DATE_LENGTH];
+    char end[MAX_DATE_LENGTH];
+    char max[16];
+    uint64_t seed;
+    int64_t commits;             /* Planned, so known without asking the child */
+    pid_t pid;
+    FILE* log;                   /* The child's stderr */
+    double started;
+    double seconds;
+    int status;                  /* Exit status; -1 if the job never ran */
+    char error[MAX_ERROR_LENGTH];
+    int64_t* shared;             /* Shared store hits and bytes, written by the child */
+} ManifestJob;
+
+/**
+ * Read a manifest: one "path start end max [seed]" job per line, with
+ * blank lines and # comments ignored. Bad lines become failed jobs.
+ * @param path: Manifest file
+ * @param base_seed: Seed that jobs without their own derive theirs from
+ * @param jobs: Output array, to be freed by the caller
+ * @return: Number of jobs, or -1 if the file cannot be read
+ */
+int read_manifest(const char* path, uint64_t base_seed, ManifestJob** jobs) {
+    FILE* file = fopen(path, "r");
+    char text[MAX_PATH_LENGTH + 128];
+    int count = 0, allocated = 0, line = 0;
+    
+    *jobs = NULL;
+    if (!file) {
+        fprintf(stderr, "Error: Cannot read manifest %s\n", path);
+        return -1;
+    }
+    while (fgets(text, sizeof(text), file)) {
+        char seed[32] = "";
+        ManifestJob* job;
+        Date start_date, end_date;
+        int fields, max;
+        
+        line++;
+        text[strcspn(text, "#\n")] = '\0';
+        if (text[strspn(text, " \t\r")] == '\0') {
+            continue;
+        }
+        if (count == allocated) {
+            allocated = allocated ? allocated * 2 : 16;
+            job = realloc(*jobs, allocated * sizeof(*job));
+            if (!job) {
+                fprintf(stderr, "Error: Out of memory\n");
+                fclose(file);
+                return -1;
+            }
+            *jobs = job;
+        }
+        job = &(*jobs)[count++];
+        memset(job, 0, sizeof(*job));
+        job->line = line;
+        job->status = -1;
+        fields = sscanf(text, "%255s %31s %31s %15s %31s", job->path, job->start, job->end,
+                        job->max, seed);
+        
+        /* The same checks the command line gets, so a bad line fails alone */
+        max = atoi(job->max);
+        if (fields < 4) {
+            snprintf(job->error, sizeof(job->error), "expected: path start end max [seed]");
+        } else if (!parse_date(job->start, &start_date) || !parse_date(job->end, &end_date)) {
+            snprintf(job->error, sizeof(job->error), "dates must be YYYY-MM-DD");
+        } else if (max < 1 || max > 50) {
+            snprintf(job->error, sizeof(job->error), "max commits per day must be 1 to 50");
+        } else if (fields == 5 && !parse_seed(seed, &job->seed)) {
+            snprintf(job->error, sizeof(job->error), "seed must be a number from 0 to %llu",
+                     (unsigned long long)UINT64_MAX);
+        } else {
+            int64_t start_day = days_from_civil(start_date.year, start_date.month, start_date.day);
+            int64_t end_day = days_from_civil(end_date.year, end_date.month, end_date.day);
+            
+            if (fields < 5) {
+                job->seed = splitmix64_mix(base_seed + (uint64_t)line) >> 16;
+            }
+            for (int64_t day = start_day; day <= end_day; day++) {
+                job->commits += plan_commits_on(job->seed, day, max);
+            }
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+/**
+ * Fork a child that runs one job in its directory
+ * @param options: Options shared by every job
+ * @param job: Job to start
+ * @return: 1 if the child started, 0 if not (the job is marked failed)
+ */
+int start_manifest_job(const Options* options, ManifestJob* job) {
+    int status;
+    
+    job->log = tmpfile();
+    if (!job->log) {
+        snprintf(job->error, sizeof(job->error), "cannot create a log file");
+        return 0;
+    }
+    fcntl(fileno(job->log), F_SETFD, FD_CLOEXEC);
+    
+    fflush(stdout);
+    fflush(stderr);
+    job->started = monotonic_seconds();
+    job->pid = fork();
+    if (job->pid < 0) {
+        snprintf(job->error, sizeof(job->error), "cannot fork: %s", strerror(errno));
+        return 0;
+    }
+    if (job->pid == 0) {
+        Options job_options = *options;
+        int null = open("/dev/null", O_WRONLY);
+        
+        /* Only errors are kept; the parent reports progress per job */
+        dup2(null, STDOUT_FILENO);
+        dup2(fileno(job->log), STDERR_FILENO);
+        if (chdir(job->path) != 0 &&
+            (errno != ENOENT || mkdir(job->path, 0777) != 0 || chdir(job->path) != 0)) {
+            fprintf(stderr, "Error: Cannot enter %s: %s\n", job->path, strerror(errno));
+            exit(1);
+        }
+        job_options.manifest = NULL;
+        job_options.seed = job->seed;
+        job_options.has_seed = 1;
+        status = run_cyclops(&job_options, job->start, job->end, job->max);
+        job->shared[0] = shared_hits;
+        job->shared[1] = shared_bytes;
+        exit(status);
+    }
+    return 1;
+}
+
+/**
+ * Keep the last line a finished job wrote to stderr, then close its log
+ * @param job: Finished job
+ */
+void collect_manifest_log(ManifestJob* job) {
+    char line[MAX_ERROR_LENGTH];
+    
+    rewind(job->log);
+    while (fgets(line, sizeof(line), job->log)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0]) {
+            snprintf(job->error, sizeof(job->error), "%s", line);
+        }
+    }
+    fclose(job->log);
+    job->log = NULL;
+}
+
+/**
+ * Print one finished job
+ * @param job: Finished job
+ * @param done: Jobs finished so far, this one included
+ * @param count: Jobs in the manifest
+ */
+void print_manifest_job(const ManifestJob* job, int done, int count) {
+    if (job->status == 0 && shared_objects) {
+        printf("[%*d/%d] ok           %s  %lld commits in %.2fs (seed %llu), %lld objects shared\n",
+               count >= 10 ? 2 : 1, done, count, job->path, (long long)job->commits,
+               job->seconds, (unsigned long long)job->seed, (long long)job->shared[0]);
+    } else if (job->status == 0) {
+        printf("[%*d/%d] ok           %s  %lld commits in %.2fs (seed %llu)\n",
+               count >= 10 ? 2 : 1, done, count, job->path, (long long)job->commits,
+               job->seconds, (unsigned long long)job->seed);
+    } else {
+        printf("[%*d/%d] %-12s %s  line %d: %s\n", count >= 10 ? 2 : 1, done, count,
+               job->status == 130 ? "interrupted" : "FAILED", job->path, job->line,
+               job->error[0] ? job->error : "failed");
+    }
+    fflush(stdout);
+}
+
+/**
+ * Run every job of a manifest, at most options->parallel at a time; a
+ * failed job is reported and the rest carry on
+ * @param options: Options shared by every job
+ * @return: Process exit status: 0 if every job succeeded
+ */
+int run_manifest(Options* options) {
+    ManifestJob* jobs;
+    int64_t* shared;
+    char store[MAX_PATH_LENGTH];
+    int count, next = 0, running = 0, done = 0, succeeded = 0;
+    int64_t commits = 0, shared_total = 0, shared_bytes_total = 0;
+    double started = monotonic_seconds();
+    double wall;
+    
+    if (!options->has_seed) {
+        options->seed = splitmix64_mix((uint64_t)time(NULL) << 20 ^ (uint64_t)getpid()) >> 16;
+    }
+    count = read_manifest(options->manifest, options->seed, &jobs);
+    if (count < 0) {
+        return 1;
+    }
+    /* Children report their shared store counts through a shared mapping */
+    shared = mmap(NULL, (count + 1) * 2 * sizeof(*shared), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(jobs);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        jobs[i].shared = &shared[i * 2];
+    }
+    /* Children enter their own directories, so the store must be absolute;
+     * each one lists it in its own target */
+    if (options->shared_objects) {
+        char* absolute;
+        
+        mkdir(options->shared_objects, 0777);
+        if (!(absolute = realpath(options->shared_objects, NULL))) {
+            fprintf(stderr, "Error: Cannot use %s as an object store\n", options->shared_objects);
+            munmap(shared, (count + 1) * 2 * sizeof(*shared));
+            free(jobs);
+            return 1;
+        }
+        snprintf(store, sizeof(store), "%s", absolute);
+        free(absolute);
+        options->shared_objects = shared_objects = store;
+    }
+    
+    print_banner();
+    printf("Manifest: %s, %d jobs, up to %d at a time, backend %s\n\n",
+           options->manifest, count, options->parallel, options->backend->name);
+    
+    /* Children stop at a commit boundary on their own; we stop starting more */
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+    
+    while (done < count) {
+        int status;
+        pid_t pid;
+        
+        while (running < options->parallel && next < count && !interrupted) {
+            ManifestJob* job = &jobs[next++];
+            
+            if (!job->error[0] && start_manifest_job(options, job)) {
+                running++;
+            } else {
+                print_manifest_job(job, ++done, count);
+            }
+        }
+        if (running == 0) {
+            break;
+        }
+        
+        pid = wait(&status);
+        if (pid < 0) {
+            continue; /* EINTR; the loop re-checks interrupted */
+        }
+        for (int i = 0; i < next; i++) {
+            ManifestJob* job = &jobs[i];
+            
+            if (job->pid == pid && job->log) {
+                job->seconds = monotonic_seconds() - job->started;
+                job->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                collect_manifest_log(job);
+                succeeded += job->status == 0;
+                commits += job->status == 0 ? job->commits : 0;
+                shared_total += job->shared[0];
+                shared_bytes_total += job->shared[1];
+                running--;
+                print_manifest_job(job, ++done, count);
+                break;
+            }
+        }
+    }
+    wall = monotonic_seconds() - started;
+    
+    printf("\nManifest done: %d of %d jobs succeeded in %.2fs\n", succeeded, count, wall);
+    printf("Commits: %lld, %.0f commits/s overall\n", (long long)commits,
+           wall > 0 ? commits / wall : 0.0);
+    if (shared_objects) {
+        printf("Shared objects: %lld deduplicated in %s, %.1f KiB not written again\n",
+               (long long)shared_total, shared_objects, shared_bytes_total / 1024.0);
+    }
+    if (succeeded < count) {
+        printf("Not done:");
+        for (int i = 0; i < count; i++) {
+            if (jobs[i].status != 0) {
+                printf(" %s", jobs[i].path);
+            }
+        }
+        printf("\n");
+    }
+    munmap(shared, (count + 1) * 2 * sizeof(*shared));
+    free(jobs);
+    if (interrupted) {
+        return 130;
+    }
+    return succeeded == count ? 0 : 1;
+}
+
+/**
+ * Main function - The eye that sees through the hiring charade
+ */
+int main(int argc, char* argv[]) {
+    Options options;
+    int first_arg;
+    
+    /* Check command line arguments */
+    first_arg = parse_options(argc, argv, &options);
+    if (first_arg >= 0 && options.manifest && argc == first_arg) {
+        return run_manifest(&options);
+    }
+    if (first_arg >= 0 && options.resume && argc == first_arg) {
+        return run_cyclops(&options, NULL, NULL, NULL);
+    }
+    if (first_arg < 0 || options.manifest || options.resume || argc - first_arg != 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    return run_cyclops(&options, argv[first_arg], argv[first_arg + 1], argv[first_arg + 2]);
+}
+
+#endif /* CYCLOPS_NO_MAIN */